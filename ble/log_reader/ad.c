@@ -0,0 +1,217 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+
+#include "ad.h"
+
+static inline uint16_t ad_get_le16(const uint8_t *ptr)
+{
+	return ptr[0] | ptr[1] << 8;
+}
+
+void ad_iter_init(struct ad_iter *iter, const void *data, uint8_t len)
+{
+	iter->data = data;
+	iter->len = len;
+	iter->offset = 0;
+}
+
+bool ad_iter_next(struct ad_iter *iter, struct ad_field *field)
+{
+	const uint8_t *ptr = iter->data + iter->offset;
+	uint8_t remaining = iter->len - iter->offset;
+
+	/* A structure needs at least its length and type octets */
+	if (remaining < 2 || ptr[0] == 0)
+		return false;
+
+	/* Stop at a structure that runs past the end of the data */
+	if (ptr[0] >= remaining)
+		return false;
+
+	field->type = ptr[1];
+	field->len = ptr[0] - 1;
+	field->data = ptr + 2;
+
+	iter->offset += ptr[0] + 1;
+
+	return true;
+}
+
+/*
+ * Returns the length of the data left over once ad_iter_next() has
+ * stopped, which is zero for well-formed data or when the rest is
+ * zero padding.
+ */
+uint8_t ad_iter_trailing(const struct ad_iter *iter, const uint8_t **data)
+{
+	const uint8_t *ptr = iter->data + iter->offset;
+
+	if (iter->offset >= iter->len || ptr[0] == 0)
+		return 0;
+
+	if (data)
+		*data = ptr;
+
+	return iter->len - iter->offset;
+}
+
+bool ad_find(const void *data, uint8_t len, uint8_t type,
+						struct ad_field *field)
+{
+	struct ad_iter iter;
+
+	ad_iter_init(&iter, data, len);
+
+	while (ad_iter_next(&iter, field)) {
+		if (field->type == type)
+			return true;
+	}
+
+	return false;
+}
+
+uint8_t ad_uuid_size(uint8_t type)
+{
+	switch (type) {
+	case AD_TYPE_UUID16_SOME:
+	case AD_TYPE_UUID16_ALL:
+	case AD_TYPE_SOLICIT16:
+	case AD_TYPE_SERVICE_DATA16:
+		return 2;
+	case AD_TYPE_UUID32_SOME:
+	case AD_TYPE_UUID32_ALL:
+	case AD_TYPE_SOLICIT32:
+	case AD_TYPE_SERVICE_DATA32:
+		return 4;
+	case AD_TYPE_UUID128_SOME:
+	case AD_TYPE_UUID128_ALL:
+	case AD_TYPE_SOLICIT128:
+	case AD_TYPE_SERVICE_DATA128:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+bool ad_get_flags(const struct ad_field *field, uint8_t *flags)
+{
+	if (field->type != AD_TYPE_FLAGS || field->len < 1)
+		return false;
+
+	*flags = field->data[0];
+
+	return true;
+}
+
+/*
+ * UUID lists must hold at least one UUID; a trailing partial UUID is
+ * not counted.
+ */
+bool ad_get_uuids(const struct ad_field *field, struct ad_uuid_list *list)
+{
+	uint8_t size;
+
+	if (field->type == AD_TYPE_SERVICE_DATA16 ||
+				field->type == AD_TYPE_SERVICE_DATA32 ||
+				field->type == AD_TYPE_SERVICE_DATA128)
+		return false;
+
+	size = ad_uuid_size(field->type);
+	if (!size || field->len < size)
+		return false;
+
+	list->size = size;
+	list->count = field->len / size;
+	list->data = field->data;
+
+	return true;
+}
+
+/* Names are not NUL terminated and are returned with their length */
+bool ad_get_name(const struct ad_field *field, const char **name,
+							uint8_t *len)
+{
+	if (field->type != AD_TYPE_NAME_SHORT &&
+				field->type != AD_TYPE_NAME_COMPLETE)
+		return false;
+
+	*name = (const char *) field->data;
+	*len = field->len;
+
+	return true;
+}
+
+bool ad_get_tx_power(const struct ad_field *field, int8_t *power)
+{
+	if (field->type != AD_TYPE_TX_POWER || field->len < 1)
+		return false;
+
+	*power = (int8_t) field->data[0];
+
+	return true;
+}
+
+/*
+ * For 16-bit service data the UUID is also returned in id; for the
+ * larger UUID sizes only the uuid pointer is set.
+ */
+bool ad_get_service_data(const struct ad_field *field,
+						struct ad_payload *payload)
+{
+	uint8_t size;
+
+	if (field->type != AD_TYPE_SERVICE_DATA16 &&
+				field->type != AD_TYPE_SERVICE_DATA32 &&
+				field->type != AD_TYPE_SERVICE_DATA128)
+		return false;
+
+	size = ad_uuid_size(field->type);
+	if (field->len < size)
+		return false;
+
+	payload->uuid_size = size;
+	payload->uuid = field->data;
+	payload->id = size == 2 ? ad_get_le16(field->data) : 0;
+	payload->data = field->data + size;
+	payload->len = field->len - size;
+
+	return true;
+}
+
+bool ad_get_manufacturer_data(const struct ad_field *field,
+						struct ad_payload *payload)
+{
+	if (field->type != AD_TYPE_MANUFACTURER_DATA || field->len < 2)
+		return false;
+
+	payload->uuid_size = 0;
+	payload->uuid = NULL;
+	payload->id = ad_get_le16(field->data);
+	payload->data = field->data + 2;
+	payload->len = field->len - 2;
+
+	return true;
+}
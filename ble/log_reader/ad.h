@@ -0,0 +1,92 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Iterator over the AD structures of advertising or EIR data. Each
+ * structure is validated against the remaining length once in
+ * ad_iter_next(), so the returned field can be used without further
+ * bounds checks beyond its own minimum size. Fields point into the
+ * original buffer and nothing is copied or allocated.
+ */
+struct ad_iter {
+	const uint8_t *data;
+	uint8_t len;
+	uint8_t offset;
+};
+
+struct ad_field {
+	uint8_t type;
+	uint8_t len;
+	const uint8_t *data;
+};
+
+struct ad_uuid_list {
+	uint8_t size;
+	uint8_t count;
+	const uint8_t *data;
+};
+
+struct ad_payload {
+	uint8_t uuid_size;
+	uint16_t id;
+	const uint8_t *uuid;
+	uint8_t len;
+	const uint8_t *data;
+};
+
+#define AD_TYPE_FLAGS			0x01
+#define AD_TYPE_UUID16_SOME		0x02
+#define AD_TYPE_UUID16_ALL		0x03
+#define AD_TYPE_UUID32_SOME		0x04
+#define AD_TYPE_UUID32_ALL		0x05
+#define AD_TYPE_UUID128_SOME		0x06
+#define AD_TYPE_UUID128_ALL		0x07
+#define AD_TYPE_NAME_SHORT		0x08
+#define AD_TYPE_NAME_COMPLETE		0x09
+#define AD_TYPE_TX_POWER		0x0a
+#define AD_TYPE_SOLICIT16		0x14
+#define AD_TYPE_SOLICIT128		0x15
+#define AD_TYPE_SERVICE_DATA16		0x16
+#define AD_TYPE_SOLICIT32		0x1f
+#define AD_TYPE_SERVICE_DATA32		0x20
+#define AD_TYPE_SERVICE_DATA128		0x21
+#define AD_TYPE_MANUFACTURER_DATA	0xff
+
+void ad_iter_init(struct ad_iter *iter, const void *data, uint8_t len);
+bool ad_iter_next(struct ad_iter *iter, struct ad_field *field);
+uint8_t ad_iter_trailing(const struct ad_iter *iter, const uint8_t **data);
+
+bool ad_find(const void *data, uint8_t len, uint8_t type,
+						struct ad_field *field);
+
+uint8_t ad_uuid_size(uint8_t type);
+
+bool ad_get_flags(const struct ad_field *field, uint8_t *flags);
+bool ad_get_uuids(const struct ad_field *field, struct ad_uuid_list *list);
+bool ad_get_name(const struct ad_field *field, const char **name,
+							uint8_t *len);
+bool ad_get_tx_power(const struct ad_field *field, int8_t *power);
+bool ad_get_service_data(const struct ad_field *field,
+						struct ad_payload *payload);
+bool ad_get_manufacturer_data(const struct ad_field *field,
+						struct ad_payload *payload);
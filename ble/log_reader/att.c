@@ -0,0 +1,431 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "packet.h"
+#include "hash.h"
+#include "checkpoint.h"
+#include "att.h"
+
+/*
+ * Latency histogram buckets are powers of two in microseconds, the last
+ * bucket collects everything from 2^(ATT_HIST_BUCKETS - 1) us upwards.
+ */
+#define ATT_HIST_BUCKETS	24
+
+struct att_latency {
+	unsigned long count;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	unsigned long hist[ATT_HIST_BUCKETS];
+};
+
+struct att_pending {
+	uint8_t opcode;
+	struct timeval tv;
+};
+
+struct att_attr {
+	uint16_t handle;
+	unsigned long notifications;
+	unsigned long indications;
+};
+
+struct att_conn {
+	uint16_t index;
+	uint16_t handle;
+	struct att_pending req[2];
+	struct att_pending ind[2];
+	struct att_latency req_latency;
+	struct att_latency ind_latency;
+	unsigned long errors;
+	unsigned long unanswered;
+	unsigned long unexpected;
+	struct hash *attr_hash;
+};
+
+static struct hash *conn_hash = NULL;
+
+static struct att_conn *get_conn(uint16_t index, uint16_t handle)
+{
+	uint64_t key = ((uint64_t) index << 16) | handle;
+	struct att_conn *conn;
+
+	if (!conn_hash) {
+		conn_hash = hash_new();
+		if (!conn_hash)
+			return NULL;
+	}
+
+	conn = hash_lookup(conn_hash, key);
+	if (conn)
+		return conn;
+
+	conn = new0(struct att_conn, 1);
+	if (!conn)
+		return NULL;
+
+	conn->index = index;
+	conn->handle = handle;
+	conn->attr_hash = hash_new();
+
+	if (!hash_insert(conn_hash, key, conn)) {
+		hash_destroy(conn->attr_hash, NULL);
+		free(conn);
+		return NULL;
+	}
+
+	return conn;
+}
+
+static struct att_attr *get_attr(struct att_conn *conn, uint16_t handle)
+{
+	struct att_attr *attr;
+
+	attr = hash_lookup(conn->attr_hash, handle);
+	if (attr)
+		return attr;
+
+	attr = new0(struct att_attr, 1);
+	if (!attr)
+		return NULL;
+
+	attr->handle = handle;
+
+	if (!hash_insert(conn->attr_hash, handle, attr)) {
+		free(attr);
+		return NULL;
+	}
+
+	return attr;
+}
+
+static void latency_add(struct att_latency *latency,
+				const struct timeval *start,
+				const struct timeval *end)
+{
+	struct timeval res;
+	uint64_t usec;
+	unsigned int bucket = 0;
+
+	timersub(end, start, &res);
+	if (res.tv_sec < 0)
+		return;
+
+	usec = res.tv_sec * 1000000ULL + res.tv_usec;
+
+	if (!latency->count || usec < latency->min)
+		latency->min = usec;
+
+	if (usec > latency->max)
+		latency->max = usec;
+
+	latency->count++;
+	latency->total += usec;
+
+	while (bucket < ATT_HIST_BUCKETS - 1 && (usec >> (bucket + 1)))
+		bucket++;
+
+	latency->hist[bucket]++;
+}
+
+static bool is_request(uint8_t opcode)
+{
+	switch (opcode) {
+	case 0x02:	/* Exchange MTU Request */
+	case 0x04:	/* Find Information Request */
+	case 0x06:	/* Find By Type Value Request */
+	case 0x08:	/* Read By Type Request */
+	case 0x0a:	/* Read Request */
+	case 0x0c:	/* Read Blob Request */
+	case 0x0e:	/* Read Multiple Request */
+	case 0x10:	/* Read By Group Type Request */
+	case 0x12:	/* Write Request */
+	case 0x16:	/* Prepare Write Request */
+	case 0x18:	/* Execute Write Request */
+	case 0x20:	/* Read Multiple Variable Request */
+		return true;
+	}
+
+	return false;
+}
+
+static bool is_response(uint8_t opcode)
+{
+	return is_request(opcode - 1);
+}
+
+static void complete_request(struct att_conn *conn, bool in, uint8_t opcode)
+{
+	struct att_pending *req = &conn->req[!in];
+
+	/* Responses travel opposite to the request they answer */
+	if (!req->opcode || (opcode && req->opcode != opcode)) {
+		conn->unexpected++;
+		return;
+	}
+
+	latency_add(&conn->req_latency, &req->tv, packet_get_time());
+	req->opcode = 0x00;
+}
+
+void att_track(uint16_t index, bool in, uint16_t handle,
+					const void *data, uint16_t size)
+{
+	const uint8_t *pdu = data;
+	struct att_conn *conn;
+	struct att_attr *attr;
+	uint8_t opcode;
+
+	if (size < 1)
+		return;
+
+	conn = get_conn(index, handle);
+	if (!conn)
+		return;
+
+	opcode = pdu[0];
+
+	if (is_request(opcode)) {
+		if (conn->req[in].opcode)
+			conn->unanswered++;
+
+		conn->req[in].opcode = opcode;
+		conn->req[in].tv = *packet_get_time();
+		return;
+	}
+
+	if (is_response(opcode)) {
+		complete_request(conn, in, opcode - 1);
+		return;
+	}
+
+	switch (opcode) {
+	case 0x01:	/* Error Response */
+		if (size < 2)
+			break;
+		conn->errors++;
+		complete_request(conn, in, pdu[1]);
+		break;
+
+	case 0x1b:	/* Handle Value Notification */
+		if (size < 3)
+			break;
+		attr = get_attr(conn, get_le16(pdu + 1));
+		if (attr)
+			attr->notifications++;
+		break;
+
+	case 0x1d:	/* Handle Value Indication */
+		if (size < 3)
+			break;
+		attr = get_attr(conn, get_le16(pdu + 1));
+		if (attr)
+			attr->indications++;
+
+		if (conn->ind[in].opcode)
+			conn->unanswered++;
+
+		conn->ind[in].opcode = opcode;
+		conn->ind[in].tv = *packet_get_time();
+		break;
+
+	case 0x1e:	/* Handle Value Confirmation */
+		if (!conn->ind[!in].opcode) {
+			conn->unexpected++;
+			break;
+		}
+
+		latency_add(&conn->ind_latency, &conn->ind[!in].tv,
+							packet_get_time());
+		conn->ind[!in].opcode = 0x00;
+		break;
+	}
+}
+
+static void print_latency(const char *label,
+					const struct att_latency *latency)
+{
+	unsigned int i;
+
+	if (!latency->count)
+		return;
+
+	printf("    %s: %lu\n", label, latency->count);
+	printf("      Latency: min %" PRIu64 " us avg %" PRIu64
+				" us max %" PRIu64 " us\n", latency->min,
+				latency->total / latency->count, latency->max);
+
+	for (i = 0; i < ATT_HIST_BUCKETS; i++) {
+		if (!latency->hist[i])
+			continue;
+
+		if (i == ATT_HIST_BUCKETS - 1)
+			printf("        >= %8lu us: %lu\n",
+						1UL << i, latency->hist[i]);
+		else
+			printf("        %8lu - %8lu us: %lu\n",
+						i ? 1UL << i : 0UL,
+						(1UL << (i + 1)) - 1,
+						latency->hist[i]);
+	}
+}
+
+static void print_attr(uint64_t key, void *value, void *user_data)
+{
+	struct att_attr *attr = value;
+
+	printf("      Handle 0x%4.4x: %lu notifications, %lu indications\n",
+				attr->handle, attr->notifications,
+				attr->indications);
+}
+
+static void print_conn(uint64_t key, void *value, void *user_data)
+{
+	struct att_conn *conn = value;
+
+	printf("  Connection: index %u handle %u\n", conn->index,
+								conn->handle);
+
+	print_latency("Requests", &conn->req_latency);
+	print_latency("Indications", &conn->ind_latency);
+
+	if (conn->errors)
+		printf("    Error responses: %lu\n", conn->errors);
+
+	if (conn->unanswered)
+		printf("    Unanswered: %lu\n", conn->unanswered);
+
+	if (conn->unexpected)
+		printf("    Unexpected responses: %lu\n", conn->unexpected);
+
+	if (hash_count(conn->attr_hash)) {
+		printf("    Notifications and indications:\n");
+		hash_foreach(conn->attr_hash, print_attr, NULL);
+	}
+}
+
+static void free_conn(void *value)
+{
+	struct att_conn *conn = value;
+
+	hash_destroy(conn->attr_hash, free);
+	free(conn);
+}
+
+void att_print_summary(void)
+{
+	if (!hash_count(conn_hash))
+		return;
+
+	printf("\nATT summary\n");
+
+	hash_foreach(conn_hash, print_conn, NULL);
+
+	hash_destroy(conn_hash, free_conn);
+	conn_hash = NULL;
+}
+
+static void save_attr(uint64_t key, void *value, void *user_data)
+{
+	checkpoint_put(user_data, value, sizeof(struct att_attr));
+}
+
+/* Everything up to the attribute table is plain data */
+static void save_conn(uint64_t key, void *value, void *user_data)
+{
+	struct att_conn *conn = value;
+	struct checkpoint *ckpt = user_data;
+
+	checkpoint_put(ckpt, conn, offsetof(struct att_conn, attr_hash));
+	checkpoint_put_u32(ckpt, hash_count(conn->attr_hash));
+	hash_foreach(conn->attr_hash, save_attr, ckpt);
+}
+
+void att_save_state(struct checkpoint *ckpt)
+{
+	checkpoint_put_u32(ckpt, hash_count(conn_hash));
+	hash_foreach(conn_hash, save_conn, ckpt);
+}
+
+static bool restore_conn(struct checkpoint *ckpt)
+{
+	struct att_conn *conn, saved;
+	struct att_attr *attr;
+	uint32_t i, count;
+
+	if (!checkpoint_get(ckpt, &saved, offsetof(struct att_conn,
+								attr_hash)))
+		return false;
+
+	conn = get_conn(saved.index, saved.handle);
+	if (!conn || !conn->attr_hash)
+		return false;
+
+	memcpy(conn, &saved, offsetof(struct att_conn, attr_hash));
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		attr = new0(struct att_attr, 1);
+		if (!attr)
+			return false;
+
+		if (!checkpoint_get(ckpt, attr, sizeof(*attr)) ||
+				!hash_insert(conn->attr_hash, attr->handle,
+									attr)) {
+			free(attr);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool att_restore_state(struct checkpoint *ckpt)
+{
+	uint32_t i, count;
+
+	hash_destroy(conn_hash, free_conn);
+	conn_hash = NULL;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (!restore_conn(ckpt))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,347 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "src/shared/util.h"
+
+#include "packet.h"
+#include "l2cap.h"
+#include "sdp.h"
+#include "att.h"
+#include "rfcomm.h"
+#include "ll.h"
+#include "keys.h"
+#include "checkpoint.h"
+
+/*
+ * A checkpoint is a snapshot of every piece of decoder state that
+ * carries over between packets. Each module serializes its own state
+ * and the snapshots are appended to <trace>.ckpt together with the
+ * packet number and file offset they were taken at, so decoding can
+ * resume from the nearest snapshot instead of from packet zero.
+ *
+ * Snapshots use the in-memory layout of the decoder structures and are
+ * only meant to be read back by the same build that wrote them. The
+ * header records the size and modification time of the trace, and the
+ * snapshots are not used once the trace no longer matches.
+ */
+#define CHECKPOINT_VERSION	1
+
+static const uint8_t checkpoint_id[8] = { 'b', 't', 'm', 'o',
+						'n', 'c', 'k', 'p' };
+
+struct checkpoint_hdr {
+	uint8_t id[8];
+	uint32_t version;
+	uint32_t mtime_nsec;
+	uint64_t mtime_sec;
+	uint64_t size;
+} __attribute__ ((packed));
+
+struct checkpoint_rec {
+	uint64_t num;
+	uint64_t offset;
+	uint64_t sec;
+	uint32_t usec;
+	uint32_t len;
+} __attribute__ ((packed));
+
+struct checkpoint_file {
+	FILE *fp;
+	struct checkpoint ckpt;
+};
+
+void checkpoint_put(struct checkpoint *ckpt, const void *data, size_t len)
+{
+	uint8_t *new_data;
+	size_t new_size;
+
+	if (ckpt->error)
+		return;
+
+	if (ckpt->len + len > ckpt->size) {
+		new_size = ckpt->size ? ckpt->size : 4096;
+		while (new_size < ckpt->len + len)
+			new_size *= 2;
+
+		new_data = realloc(ckpt->data, new_size);
+		if (!new_data) {
+			ckpt->error = true;
+			return;
+		}
+
+		ckpt->data = new_data;
+		ckpt->size = new_size;
+	}
+
+	memcpy(ckpt->data + ckpt->len, data, len);
+	ckpt->len += len;
+}
+
+bool checkpoint_get(struct checkpoint *ckpt, void *data, size_t len)
+{
+	if (ckpt->error || ckpt->len - ckpt->pos < len) {
+		ckpt->error = true;
+		return false;
+	}
+
+	memcpy(data, ckpt->data + ckpt->pos, len);
+	ckpt->pos += len;
+
+	return true;
+}
+
+static bool get_trace(const char *path, struct checkpoint_hdr *hdr)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return false;
+
+	hdr->mtime_nsec = st.st_mtim.tv_nsec;
+	hdr->mtime_sec = st.st_mtim.tv_sec;
+	hdr->size = st.st_size;
+
+	return true;
+}
+
+static char *checkpoint_path(const char *path)
+{
+	char *str;
+
+	if (asprintf(&str, "%s.ckpt", path) < 0)
+		return NULL;
+
+	return str;
+}
+
+struct checkpoint_file *checkpoint_file_create(const char *path)
+{
+	struct checkpoint_file *file;
+	struct checkpoint_hdr hdr;
+	char *ckpt_path;
+
+	if (!get_trace(path, &hdr))
+		return NULL;
+
+	ckpt_path = checkpoint_path(path);
+	if (!ckpt_path)
+		return NULL;
+
+	file = new0(struct checkpoint_file, 1);
+	if (!file) {
+		free(ckpt_path);
+		return NULL;
+	}
+
+	file->fp = fopen(ckpt_path, "we");
+	free(ckpt_path);
+
+	if (!file->fp) {
+		free(file);
+		return NULL;
+	}
+
+	memcpy(hdr.id, checkpoint_id, sizeof(checkpoint_id));
+	hdr.version = CHECKPOINT_VERSION;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, file->fp) != 1) {
+		checkpoint_file_close(file);
+		return NULL;
+	}
+
+	return file;
+}
+
+bool checkpoint_file_add(struct checkpoint_file *file, unsigned long num,
+				uint64_t offset, const struct timeval *tv)
+{
+	struct checkpoint *ckpt = &file->ckpt;
+	struct checkpoint_rec rec;
+
+	ckpt->len = 0;
+	ckpt->pos = 0;
+	ckpt->error = false;
+
+	packet_save_state(ckpt);
+	l2cap_save_state(ckpt);
+	sdp_save_state(ckpt);
+	att_save_state(ckpt);
+	rfcomm_save_state(ckpt);
+	ll_save_state(ckpt);
+	keys_save_state(ckpt);
+
+	if (ckpt->error)
+		return false;
+
+	rec.num = num;
+	rec.offset = offset;
+	rec.sec = tv->tv_sec;
+	rec.usec = tv->tv_usec;
+	rec.len = ckpt->len;
+
+	if (fwrite(&rec, sizeof(rec), 1, file->fp) != 1)
+		return false;
+
+	if (fwrite(ckpt->data, ckpt->len, 1, file->fp) != 1)
+		return false;
+
+	return true;
+}
+
+void checkpoint_file_close(struct checkpoint_file *file)
+{
+	if (!file)
+		return;
+
+	fclose(file->fp);
+	free(file->ckpt.data);
+	free(file);
+}
+
+static bool restore_state(struct checkpoint *ckpt)
+{
+	if (!packet_restore_state(ckpt))
+		return false;
+
+	if (!l2cap_restore_state(ckpt))
+		return false;
+
+	if (!sdp_restore_state(ckpt))
+		return false;
+
+	if (!att_restore_state(ckpt))
+		return false;
+
+	if (!rfcomm_restore_state(ckpt))
+		return false;
+
+	if (!ll_restore_state(ckpt))
+		return false;
+
+	if (!keys_restore_state(ckpt))
+		return false;
+
+	return ckpt->pos == ckpt->len;
+}
+
+/*
+ * Returns 0 when decoding has been moved to a snapshot, -ENOENT when no
+ * usable snapshot exists and -EINVAL when a snapshot failed to restore
+ * after the decoder state was already modified.
+ */
+int checkpoint_restore(const char *path, unsigned long start,
+				const struct timeval *start_time,
+				unsigned long *num, uint64_t *offset)
+{
+	struct checkpoint ckpt = { };
+	struct checkpoint_hdr hdr, trace;
+	struct checkpoint_rec rec;
+	long best = -1;
+	int err = -ENOENT;
+	char *ckpt_path;
+	FILE *fp;
+
+	if (!get_trace(path, &trace))
+		return -ENOENT;
+
+	ckpt_path = checkpoint_path(path);
+	if (!ckpt_path)
+		return -ENOENT;
+
+	fp = fopen(ckpt_path, "re");
+	free(ckpt_path);
+
+	if (!fp)
+		return -ENOENT;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+			memcmp(hdr.id, checkpoint_id, sizeof(checkpoint_id)) ||
+			hdr.version != CHECKPOINT_VERSION)
+		goto done;
+
+	if (hdr.size != trace.size || hdr.mtime_sec != trace.mtime_sec ||
+				hdr.mtime_nsec != trace.mtime_nsec) {
+		fprintf(stderr, "Ignoring checkpoints of %s, the trace has "
+						"changed since\n", path);
+		goto done;
+	}
+
+	/* Find the last snapshot taken before the requested start */
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		long pos = ftell(fp) - sizeof(rec);
+
+		/* A zero start means no packet number was given */
+		if (start && rec.num > start)
+			break;
+
+		if (timerisset(start_time) &&
+				(rec.sec > (uint64_t) start_time->tv_sec ||
+				(rec.sec == (uint64_t) start_time->tv_sec &&
+				rec.usec > (uint32_t) start_time->tv_usec)))
+			break;
+
+		best = pos;
+
+		if (fseek(fp, rec.len, SEEK_CUR) < 0)
+			break;
+	}
+
+	if (best < 0 || fseek(fp, best, SEEK_SET) < 0)
+		goto done;
+
+	if (fread(&rec, sizeof(rec), 1, fp) != 1)
+		goto done;
+
+	ckpt.data = malloc(rec.len);
+	if (!ckpt.data)
+		goto done;
+
+	ckpt.len = rec.len;
+	ckpt.size = rec.len;
+
+	if (fread(ckpt.data, rec.len, 1, fp) != 1)
+		goto done;
+
+	if (!restore_state(&ckpt)) {
+		err = -EINVAL;
+		goto done;
+	}
+
+	*num = rec.num;
+	*offset = rec.offset;
+	err = 0;
+
+done:
+	free(ckpt.data);
+	fclose(fp);
+
+	return err;
+}
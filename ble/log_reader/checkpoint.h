@@ -0,0 +1,57 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+struct checkpoint {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+	size_t pos;
+	bool error;
+};
+
+void checkpoint_put(struct checkpoint *ckpt, const void *data, size_t len);
+bool checkpoint_get(struct checkpoint *ckpt, void *data, size_t len);
+
+static inline void checkpoint_put_u32(struct checkpoint *ckpt, uint32_t value)
+{
+	checkpoint_put(ckpt, &value, sizeof(value));
+}
+
+static inline bool checkpoint_get_u32(struct checkpoint *ckpt,
+							uint32_t *value)
+{
+	return checkpoint_get(ckpt, value, sizeof(*value));
+}
+
+struct checkpoint_file;
+
+struct checkpoint_file *checkpoint_file_create(const char *path);
+bool checkpoint_file_add(struct checkpoint_file *file, unsigned long num,
+				uint64_t offset, const struct timeval *tv);
+void checkpoint_file_close(struct checkpoint_file *file);
+
+int checkpoint_restore(const char *path, unsigned long start,
+				const struct timeval *start_time,
+				unsigned long *num, uint64_t *offset);
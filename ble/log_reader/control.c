@@ -31,9 +31,12 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -52,25 +55,57 @@
 #include "packet.h"
 #include "hcidump.h"
 #include "ellisys.h"
-#include "tty.h"
+#include "writer.h"
+#include "fanout.h"
+#include "reader.h"
+#include "render.h"
+#include "mapfile.h"
+#include "pktindex.h"
+#include "checkpoint.h"
+#include "att.h"
+#include "rfcomm.h"
+#include "ll.h"
+#include "stats.h"
+#include "ttyring.h"
+#include "output.h"
 #include "control.h"
 
 static struct btsnoop *btsnoop_file = NULL;
+static struct writer *writer = NULL;
 static bool hcidump_fallback = false;
 
+#define CONTROL_BATCH_SIZE	32
+
+struct control_batch {
+	struct mmsghdr msgs[CONTROL_BATCH_SIZE];
+	struct iovec iov[CONTROL_BATCH_SIZE][2];
+	struct mgmt_hdr hdr[CONTROL_BATCH_SIZE];
+	unsigned char control[CONTROL_BATCH_SIZE][64];
+	unsigned char buf[CONTROL_BATCH_SIZE][BTSNOOP_MAX_PACKET_SIZE];
+};
+
 struct control_data {
 	uint16_t channel;
 	int fd;
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
 	uint16_t offset;
+	struct control_batch *batch;
+	struct tty_ring *ring;
 };
 
+static unsigned long recv_calls = 0;
+static unsigned long recv_msgs = 0;
+
+static struct tty_ring_stats tty_stats;
+
 static void free_data(void *user_data)
 {
 	struct control_data *data = user_data;
 
 	close(data->fd);
 
+	tty_ring_free(data->ring);
+	free(data->batch);
 	free(data);
 }
 
@@ -904,81 +939,117 @@ void control_message(uint16_t opcode, const void *data, uint16_t size)
 	}
 }
 
+static void data_dispatch(struct control_data *data, struct msghdr *msg,
+				const struct mgmt_hdr *hdr, unsigned char *buf)
+{
+	struct cmsghdr *cmsg;
+	struct timeval *tv = NULL;
+	struct timeval ctv;
+	struct ucred *cred = NULL;
+	struct ucred ccred;
+	uint16_t opcode, index, pktlen;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+				cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+			memcpy(&ctv, CMSG_DATA(cmsg), sizeof(ctv));
+			tv = &ctv;
+		}
+
+		if (cmsg->cmsg_type == SCM_CREDENTIALS) {
+			memcpy(&ccred, CMSG_DATA(cmsg), sizeof(ccred));
+			cred = &ccred;
+		}
+	}
+
+	opcode = le16_to_cpu(hdr->opcode);
+	index  = le16_to_cpu(hdr->index);
+	pktlen = le16_to_cpu(hdr->len);
+
+	switch (data->channel) {
+	case HCI_CHANNEL_CONTROL:
+		packet_control(tv, cred, index, opcode, buf, pktlen);
+		break;
+	case HCI_CHANNEL_MONITOR:
+		writer_write_hci(writer, tv, index, opcode, 0, buf, pktlen);
+		fanout_hci(index, opcode, buf, pktlen);
+		ellisys_inject_hci(tv, index, opcode, buf, pktlen);
+		packet_set_time(tv);
+		packet_monitor(tv, cred, index, opcode, buf, pktlen);
+		break;
+	}
+}
+
 static void data_callback(int fd, uint32_t events, void *user_data)
 {
 	struct control_data *data = user_data;
-	unsigned char control[64];
-	struct mgmt_hdr hdr;
-	struct msghdr msg;
-	struct iovec iov[2];
+	struct control_batch *batch = data->batch;
 
 	if (events & (EPOLLERR | EPOLLHUP)) {
 		mainloop_remove_fd(data->fd);
 		return;
 	}
 
-	iov[0].iov_base = &hdr;
-	iov[0].iov_len = MGMT_HDR_SIZE;
-	iov[1].iov_base = data->buf;
-	iov[1].iov_len = sizeof(data->buf);
+	while (1) {
+		int i, count;
 
-	memset(&msg, 0, sizeof(msg));
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 2;
-	msg.msg_control = control;
-	msg.msg_controllen = sizeof(control);
+		/* The kernel shrinks msg_controllen to what it filled in */
+		for (i = 0; i < CONTROL_BATCH_SIZE; i++) {
+			batch->msgs[i].msg_hdr.msg_controllen =
+						sizeof(batch->control[i]);
+			batch->msgs[i].msg_hdr.msg_flags = 0;
+		}
 
-	while (1) {
-		struct cmsghdr *cmsg;
-		struct timeval *tv = NULL;
-		struct timeval ctv;
-		struct ucred *cred = NULL;
-		struct ucred ccred;
-		uint16_t opcode, index, pktlen;
-		ssize_t len;
-
-		len = recvmsg(data->fd, &msg, MSG_DONTWAIT);
-		if (len < 0)
+		count = recvmmsg(data->fd, batch->msgs, CONTROL_BATCH_SIZE,
+							MSG_DONTWAIT, NULL);
+		if (count <= 0)
 			break;
 
-		if (len < MGMT_HDR_SIZE)
-			break;
+		recv_calls++;
+		recv_msgs += count;
 
-		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
-					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-			if (cmsg->cmsg_level != SOL_SOCKET)
+		for (i = 0; i < count; i++) {
+			if (batch->msgs[i].msg_len < MGMT_HDR_SIZE)
 				continue;
 
-			if (cmsg->cmsg_type == SCM_TIMESTAMP) {
-				memcpy(&ctv, CMSG_DATA(cmsg), sizeof(ctv));
-				tv = &ctv;
-			}
-
-			if (cmsg->cmsg_type == SCM_CREDENTIALS) {
-				memcpy(&ccred, CMSG_DATA(cmsg), sizeof(ccred));
-				cred = &ccred;
-			}
+			data_dispatch(data, &batch->msgs[i].msg_hdr,
+					&batch->hdr[i], batch->buf[i]);
 		}
 
-		opcode = le16_to_cpu(hdr.opcode);
-		index  = le16_to_cpu(hdr.index);
-		pktlen = le16_to_cpu(hdr.len);
-
-		switch (data->channel) {
-		case HCI_CHANNEL_CONTROL:
-			packet_control(tv, cred, index, opcode,
-							data->buf, pktlen);
+		if (count < CONTROL_BATCH_SIZE)
 			break;
-		case HCI_CHANNEL_MONITOR:
-			btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0,
-							data->buf, pktlen);
-			ellisys_inject_hci(tv, index, opcode,
-							data->buf, pktlen);
-			packet_monitor(tv, cred, index, opcode,
-							data->buf, pktlen);
-			break;
-		}
 	}
+
+	output_flush();
+}
+
+static struct control_batch *batch_new(void)
+{
+	struct control_batch *batch;
+	int i;
+
+	batch = new0(struct control_batch, 1);
+	if (!batch)
+		return NULL;
+
+	for (i = 0; i < CONTROL_BATCH_SIZE; i++) {
+		struct msghdr *msg = &batch->msgs[i].msg_hdr;
+
+		batch->iov[i][0].iov_base = &batch->hdr[i];
+		batch->iov[i][0].iov_len = MGMT_HDR_SIZE;
+		batch->iov[i][1].iov_base = batch->buf[i];
+		batch->iov[i][1].iov_len = sizeof(batch->buf[i]);
+
+		msg->msg_iov = batch->iov[i];
+		msg->msg_iovlen = 2;
+		msg->msg_control = batch->control[i];
+		msg->msg_controllen = sizeof(batch->control[i]);
+	}
+
+	return batch;
 }
 
 static int open_socket(uint16_t channel)
@@ -1035,8 +1106,15 @@ static int open_channel(uint16_t channel)
 	memset(data, 0, sizeof(*data));
 	data->channel = channel;
 
+	data->batch = batch_new();
+	if (!data->batch) {
+		free(data);
+		return -1;
+	}
+
 	data->fd = open_socket(channel);
 	if (data->fd < 0) {
+		free(data->batch);
 		free(data);
 		return -1;
 	}
@@ -1069,11 +1147,14 @@ static void client_callback(int fd, uint32_t events, void *user_data)
 		uint16_t opcode, index;
 
 		if (data->offset < pktlen + MGMT_HDR_SIZE)
-			return;
+			break;
 
 		opcode = le16_to_cpu(hdr->opcode);
 		index = le16_to_cpu(hdr->index);
 
+		fanout_hci(index, opcode, data->buf + MGMT_HDR_SIZE, pktlen);
+
+		packet_set_time(NULL);
 		packet_monitor(NULL, NULL, index, opcode,
 					data->buf + MGMT_HDR_SIZE, pktlen);
 
@@ -1083,6 +1164,8 @@ static void client_callback(int fd, uint32_t events, void *user_data)
 			memmove(data->buf, data->buf + MGMT_HDR_SIZE + pktlen,
 								data->offset);
 	}
+
+	output_flush();
 }
 
 static void server_accept_callback(int fd, uint32_t events, void *user_data)
@@ -1164,147 +1247,28 @@ void control_server(const char *path)
 	server_fd = fd;
 }
 
-static bool parse_drops(uint8_t **data, uint8_t *len, uint8_t *drops,
-							uint32_t *total)
+static void tty_frame(struct timeval *tv, uint16_t opcode, uint32_t drops,
+				const void *data, uint16_t size,
+				void *user_data)
 {
-	if (*len < 1)
-		return false;
-
-	*drops = **data;
-	*total += *drops;
-	(*data)++;
-	(*len)--;
-
-	return true;
-}
-
-static bool tty_parse_header(uint8_t *hdr, uint8_t len, struct timeval **tv,
-				struct timeval *ctv, uint32_t *drops)
-{
-	uint8_t cmd = 0;
-	uint8_t evt = 0;
-	uint8_t acl_tx = 0;
-	uint8_t acl_rx = 0;
-	uint8_t sco_tx = 0;
-	uint8_t sco_rx = 0;
-	uint8_t other = 0;
-	uint32_t total = 0;
-	uint32_t ts32;
-
-	while (len) {
-		uint8_t type = hdr[0];
-
-		hdr++; len--;
-
-		switch (type) {
-		case TTY_EXTHDR_COMMAND_DROPS:
-			if (!parse_drops(&hdr, &len, &cmd, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_EVENT_DROPS:
-			if (!parse_drops(&hdr, &len, &evt, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_ACL_TX_DROPS:
-			if (!parse_drops(&hdr, &len, &acl_tx, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_ACL_RX_DROPS:
-			if (!parse_drops(&hdr, &len, &acl_rx, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_SCO_TX_DROPS:
-			if (!parse_drops(&hdr, &len, &sco_tx, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_SCO_RX_DROPS:
-			if (!parse_drops(&hdr, &len, &sco_rx, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_OTHER_DROPS:
-			if (!parse_drops(&hdr, &len, &other, &total))
-				return false;
-			break;
-		case TTY_EXTHDR_TS32:
-			if (len < sizeof(ts32))
-				return false;
-			ts32 = get_le32(hdr);
-			hdr += sizeof(ts32); len -= sizeof(ts32);
-			/* ts32 is in units of 1/10th of a millisecond */
-			ctv->tv_sec = ts32 / 10000;
-			ctv->tv_usec = (ts32 % 10000) * 100;
-			*tv = ctv;
-			break;
-		default:
-			printf("Unknown extended header type %u\n", type);
-			return false;
-		}
-	}
-
-	if (total) {
-		*drops += total;
-		printf("* Drops: cmd %u evt %u acl_tx %u acl_rx %u sco_tx %u "
-			"sco_rx %u other %u\n", cmd, evt, acl_tx, acl_rx,
-			sco_tx, sco_rx, other);
-	}
-
-	return true;
+	writer_write_hci(writer, tv, 0, opcode, drops, data, size);
+	fanout_hci(0, opcode, data, size);
+	packet_set_time(tv);
+	packet_monitor(tv, NULL, 0, opcode, data, size);
 }
 
 static void tty_callback(int fd, uint32_t events, void *user_data)
 {
 	struct control_data *data = user_data;
-	ssize_t len;
 
 	if (events & (EPOLLERR | EPOLLHUP)) {
 		mainloop_remove_fd(data->fd);
 		return;
 	}
 
-	len = read(data->fd, data->buf + data->offset,
-					sizeof(data->buf) - data->offset);
-	if (len < 0)
-		return;
-
-	data->offset += len;
-
-	while (data->offset >= sizeof(struct tty_hdr)) {
-		struct tty_hdr *hdr = (struct tty_hdr *) data->buf;
-		uint16_t pktlen, opcode, data_len;
-		struct timeval *tv = NULL;
-		struct timeval ctv;
-		uint32_t drops = 0;
-
-		data_len = le16_to_cpu(hdr->data_len);
-
-		if (data->offset < 2 + data_len)
-			return;
-
-		if (data->offset < sizeof(*hdr) + hdr->hdr_len) {
-			fprintf(stderr, "Received corrupted data from TTY\n");
-			memmove(data->buf, data->buf + 2 + data_len,
-								data->offset);
-			return;
-		}
-
-		if (!tty_parse_header(hdr->ext_hdr, hdr->hdr_len,
-							&tv, &ctv, &drops))
-			fprintf(stderr, "Unable to parse extended header\n");
-
-		opcode = le16_to_cpu(hdr->opcode);
-		pktlen = data_len - 4 - hdr->hdr_len;
-
-		btsnoop_write_hci(btsnoop_file, tv, 0, opcode, drops,
-					hdr->ext_hdr + hdr->hdr_len, pktlen);
-		packet_monitor(tv, NULL, 0, opcode,
-					hdr->ext_hdr + hdr->hdr_len, pktlen);
+	tty_ring_drain(data->ring, data->fd);
 
-		data->offset -= 2 + data_len;
-
-		if (data->offset > 0)
-			memmove(data->buf, data->buf + 2 + data_len,
-								data->offset);
-	}
+	output_flush();
 }
 
 int control_tty(const char *path, unsigned int speed)
@@ -1355,30 +1319,299 @@ int control_tty(const char *path, unsigned int speed)
 	data->channel = HCI_CHANNEL_MONITOR;
 	data->fd = fd;
 
+	data->ring = tty_ring_new(&tty_stats, tty_frame, NULL);
+	if (!data->ring) {
+		free(data);
+		close(fd);
+		return -ENOMEM;
+	}
+
 	mainloop_add_fd(data->fd, EPOLLIN, tty_callback, data, free_data);
 
 	return 0;
 }
 
-bool control_writer(const char *path)
+static void writer_timeout(int id, void *user_data)
+{
+	/* Hand partially filled blocks to disk even on a quiet link */
+	writer_submit(writer);
+
+	mainloop_modify_timeout(id, 1000);
+}
+
+bool control_writer(const char *path, unsigned int sync_interval,
+			unsigned int rotate_size, unsigned int rotate_time)
+{
+	writer = writer_open(path, BTSNOOP_FORMAT_MONITOR, sync_interval,
+						rotate_size, rotate_time);
+	if (!writer)
+		return false;
+
+	mainloop_add_timeout(1000, writer_timeout, NULL, NULL);
+
+	return true;
+}
+
+void control_flush(void)
+{
+	writer_flush(writer);
+}
+
+void control_cleanup(void)
+{
+	writer_close(writer);
+	writer = NULL;
+}
+
+/*
+ * Packets before the selected start are still decoded to rebuild the
+ * protocol state, but their output is discarded. When restricted to a
+ * single handle, data packets of other connections are skipped and
+ * commands and events are only decoded for their state.
+ */
+static struct {
+	unsigned long start;
+	struct timeval start_time;
+	int index;
+	int handle;
+	unsigned long stop;
+	unsigned long num;
+	bool started;
+	bool quiet;
+	bool no_output;
+} selection = {
+	.index = -1,
+	.handle = -1,
+	.stop = ULONG_MAX,
+};
+
+void control_reader_select(unsigned long start,
+				const struct timeval *start_time, int index,
+				int handle)
+{
+	selection.start = start;
+	if (start_time)
+		selection.start_time = *start_time;
+	selection.index = index;
+	selection.handle = handle;
+}
+
+/* Save a decoder snapshot every that many packets of a mapped trace */
+#define CHECKPOINT_INTERVAL	4096
+
+static bool checkpoint_enabled = false;
+
+void control_reader_checkpoint(bool enable)
+{
+	checkpoint_enabled = enable;
+}
+
+static unsigned int render_jobs = 0;
+
+void control_reader_jobs(unsigned int jobs)
+{
+	render_jobs = jobs;
+}
+
+/*
+ * Hexdumps are rendered on worker threads only when every packet is
+ * printed, since selections and stats mode redirect output underneath.
+ */
+static void start_render(void)
+{
+	if (!render_jobs || output_suspended())
+		return;
+
+	if (selection.start || timerisset(&selection.start_time) ||
+						selection.handle >= 0)
+		return;
+
+	render_start(render_jobs);
+}
+
+static bool resume_checkpoint(const char *path, struct map_file *map)
+{
+	unsigned long num;
+	uint64_t offset;
+	int err;
+
+	if (!selection.start && !timerisset(&selection.start_time))
+		return true;
+
+	err = checkpoint_restore(path, selection.start, &selection.start_time,
+								&num, &offset);
+	if (err == -ENOENT)
+		return true;
+
+	if (err < 0 || !map_seek(map, offset)) {
+		fprintf(stderr, "Failed to restore checkpoint for %s\n", path);
+		return false;
+	}
+
+	selection.num = num;
+
+	return true;
+}
+
+static void set_quiet(bool quiet)
+{
+	if (quiet == selection.quiet)
+		return;
+
+	if (quiet)
+		output_suspend();
+	else
+		output_resume();
+
+	if (!selection.no_output) {
+		if (quiet)
+			packet_add_filter(PACKET_FILTER_NO_OUTPUT);
+		else
+			packet_del_filter(PACKET_FILTER_NO_OUTPUT);
+	}
+
+	selection.quiet = quiet;
+}
+
+/*
+ * With an index the start time and the selected handle are turned into
+ * a start packet number, so that decoding can resume from the nearest
+ * checkpoint instead of replaying the trace from the beginning.
+ */
+static bool setup_selection(const char *path)
+{
+	struct pktindex *idx;
+	unsigned long first, last, num;
+
+	selection.num = 0;
+	selection.started = false;
+	selection.no_output = packet_has_filter(PACKET_FILTER_NO_OUTPUT);
+
+	if (selection.handle < 0 && !timerisset(&selection.start_time))
+		return true;
+
+	/* Without an index the whole trace has to be scanned */
+	idx = pktindex_load(path);
+	if (!idx)
+		return true;
+
+	if (timerisset(&selection.start_time)) {
+		num = pktindex_find_time(idx, &selection.start_time);
+		if (num > selection.start)
+			selection.start = num;
+	}
+
+	if (selection.handle < 0)
+		goto done;
+
+	switch (pktindex_get_range(idx, &selection.index, selection.handle,
+							&first, &last)) {
+	case 0:
+		break;
+	case -EEXIST:
+		fprintf(stderr, "Handle %d is used by several controllers, "
+				"select one with -i\n", selection.handle);
+		pktindex_free(idx);
+		return false;
+	default:
+		fprintf(stderr, "Handle %d not found in trace\n",
+							selection.handle);
+		pktindex_free(idx);
+		return false;
+	}
+
+	/* Nothing of the handle is shown before its first packet */
+	if (first > selection.start)
+		selection.start = first;
+
+	selection.stop = last;
+
+done:
+	pktindex_free(idx);
+
+	return true;
+}
+
+static void finish_selection(void)
+{
+	set_quiet(false);
+}
+
+static bool reader_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
 {
-	btsnoop_file = btsnoop_create(path, BTSNOOP_FORMAT_MONITOR);
+	unsigned long num = selection.num++;
+	int handle;
 
-	return !!btsnoop_file;
+	if (num > selection.stop)
+		return false;
+
+	if (opcode == 0xffff)
+		return true;
+
+	if (!selection.started && num >= selection.start &&
+			!timercmp(tv, &selection.start_time, <))
+		selection.started = true;
+
+	handle = pktindex_get_handle(opcode, data, size);
+
+	if (selection.handle >= 0) {
+		if (handle >= 0 && (handle != selection.handle ||
+				(selection.index >= 0 &&
+					index != selection.index)))
+			return true;
+
+		/* Without -i the first controller using the handle is kept */
+		if (handle >= 0 && selection.index < 0)
+			selection.index = index;
+
+		set_quiet(!selection.started || handle < 0);
+	} else
+		set_quiet(!selection.started);
+
+	stats_hci(opcode, data, size);
+
+	packet_set_time(tv);
+	packet_monitor(tv, NULL, index, opcode, data, size);
+	ellisys_inject_hci(tv, index, opcode, data, size);
+
+	return true;
 }
 
 void control_reader(const char *path)
 {
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct map_file map;
+	struct reader *reader = NULL;
+	struct checkpoint_file *ckpt_file = NULL;
 	uint16_t pktlen;
 	uint32_t format;
 	struct timeval tv;
 
-	btsnoop_file = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
-	if (!btsnoop_file)
+	if (!setup_selection(path))
 		return;
 
-	format = btsnoop_get_format(btsnoop_file);
+	if (map_open(path, &map)) {
+		if (!checkpoint_enabled && !resume_checkpoint(path, &map)) {
+			map_close(&map);
+			return;
+		}
+
+		if (checkpoint_enabled) {
+			ckpt_file = checkpoint_file_create(path);
+			if (!ckpt_file)
+				fprintf(stderr, "Failed to create checkpoints "
+							"for %s\n", path);
+		}
+
+		format = BTSNOOP_FORMAT_MONITOR;
+	} else {
+		btsnoop_file = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+		if (!btsnoop_file)
+			return;
+
+		format = btsnoop_get_format(btsnoop_file);
+	}
 
 	switch (format) {
 	case BTSNOOP_FORMAT_HCI:
@@ -1392,24 +1625,65 @@ void control_reader(const char *path)
 		break;
 	}
 
+	output_flush();
 	open_pager();
 
+	start_render();
+
 	switch (format) {
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
 	case BTSNOOP_FORMAT_MONITOR:
-		while (1) {
+		while (map.base) {
+			uint64_t offset = map.offset;
+			uint16_t index, opcode;
+			const void *data;
+
+			if (!map_read_hci(&map, &tv, &index, &opcode,
+							&data, &pktlen))
+				break;
+
+			if (ckpt_file && !(selection.num % CHECKPOINT_INTERVAL) &&
+					!checkpoint_file_add(ckpt_file,
+						selection.num, offset, &tv)) {
+				fprintf(stderr, "Failed to save checkpoint\n");
+				checkpoint_file_close(ckpt_file);
+				ckpt_file = NULL;
+			}
+
+			if (!reader_hci(&tv, index, opcode, data, pktlen))
+				break;
+		}
+
+		if (btsnoop_file)
+			reader = reader_new(btsnoop_file);
+
+		while (reader) {
+			uint16_t index, opcode;
+			const void *data;
+
+			if (!reader_next(reader, &tv, &index, &opcode,
+							&data, &pktlen))
+				break;
+
+			if (!reader_hci(&tv, index, opcode, data, pktlen))
+				break;
+		}
+
+		if (reader) {
+			reader_free(reader);
+			break;
+		}
+
+		while (btsnoop_file) {
 			uint16_t index, opcode;
 
 			if (!btsnoop_read_hci(btsnoop_file, &tv, &index,
 							&opcode, buf, &pktlen))
 				break;
 
-			if (opcode == 0xffff)
-				continue;
-
-			packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
-			ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
+			if (!reader_hci(&tv, index, opcode, buf, pktlen))
+				break;
 		}
 		break;
 
@@ -1421,14 +1695,29 @@ void control_reader(const char *path)
 								buf, &pktlen))
 				break;
 
+			packet_set_time(&tv);
 			packet_simulator(&tv, frequency, buf, pktlen);
 		}
 		break;
 	}
 
+	render_stop();
+
+	finish_selection();
+
+	/* Stats mode prints the summaries once output is back */
+	if (!output_suspended())
+		control_print_summary();
+
+	output_flush();
 	close_pager();
 
+	checkpoint_file_close(ckpt_file);
+
+	map_close(&map);
+
 	btsnoop_unref(btsnoop_file);
+	btsnoop_file = NULL;
 }
 
 int control_tracing(void)
@@ -1450,3 +1739,30 @@ int control_tracing(void)
 
 	return 0;
 }
+
+void control_print_summary(void)
+{
+	att_print_summary();
+	rfcomm_print_summary();
+	ll_print_summary();
+}
+
+void control_print_stats(void)
+{
+	writer_print_stats(writer);
+
+	if (tty_stats.reads)
+		printf("TTY: %lu frames, %" PRIu64 " bytes in %lu reads, "
+				"%lu dropped by controller, %lu resyncs "
+				"(%lu bytes skipped)\n", tty_stats.frames,
+				tty_stats.bytes, tty_stats.reads,
+				tty_stats.drops, tty_stats.resyncs,
+				tty_stats.skipped);
+
+	if (!recv_calls)
+		return;
+
+	printf("Monitor socket: %lu messages in %lu receive calls "
+				"(%.1f per call)\n", recv_msgs, recv_calls,
+				(double) recv_msgs / recv_calls);
+}
@@ -23,11 +23,23 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
 
-bool control_writer(const char *path);
+bool control_writer(const char *path, unsigned int sync_interval,
+			unsigned int rotate_size, unsigned int rotate_time);
 void control_reader(const char *path);
+void control_reader_select(unsigned long start,
+				const struct timeval *start_time, int index,
+				int handle);
+void control_reader_checkpoint(bool enable);
+void control_reader_jobs(unsigned int jobs);
 void control_server(const char *path);
 int control_tty(const char *path, unsigned int speed);
 int control_tracing(void);
+void control_print_summary(void);
+void control_print_stats(void);
+void control_flush(void);
+void control_cleanup(void);
 
 void control_message(uint16_t opcode, const void *data, uint16_t size);
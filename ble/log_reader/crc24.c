@@ -0,0 +1,67 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "crc24.h"
+
+/*
+ * Byte-wise CRC24 for the LSB first bit order used on air. The table is
+ * the reflected form of the polynomial x^24 + x^10 + x^9 + x^6 + x^4 +
+ * x^3 + x + 1 and is built on first use.
+ */
+#define CRC24_POLY_REFLECTED	0xda6000
+
+static uint32_t crc24_table[256];
+
+static void crc24_init_table(void)
+{
+	uint32_t i, j, state;
+
+	for (i = 0; i < 256; i++) {
+		state = i;
+
+		for (j = 0; j < 8; j++) {
+			if (state & 1)
+				state = (state >> 1) ^ CRC24_POLY_REFLECTED;
+			else
+				state >>= 1;
+		}
+
+		crc24_table[i] = state;
+	}
+}
+
+uint32_t crc24_table_calculate(uint32_t preset, const uint8_t *data,
+							unsigned int len)
+{
+	uint32_t state = preset;
+	unsigned int i;
+
+	if (!crc24_table[1])
+		crc24_init_table();
+
+	for (i = 0; i < len; i++)
+		state = (state >> 8) ^ crc24_table[(state ^ data[i]) & 0xff];
+
+	return state;
+}
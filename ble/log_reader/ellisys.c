@@ -27,7 +27,10 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
@@ -38,12 +41,122 @@
 #include <arpa/inet.h>
 
 #include "src/shared/btsnoop.h"
+#include "packet.h"
 #include "ellisys.h"
 
+/*
+ * Datagrams are built on the caller's thread into a fixed ring of slots
+ * and a sender thread drains the ring in batches with sendmmsg(). When
+ * the analyzer cannot keep up during live capture, new datagrams are
+ * dropped and counted instead of stalling the capture. Replaying a file
+ * waits for a free slot instead, so every packet is sent.
+ */
+#define ELLISYS_HDR_SIZE	22
+#define ELLISYS_QUEUE_SIZE	1024
+#define ELLISYS_BATCH_SIZE	64
+
+struct ellisys_slot {
+	uint16_t len;
+	uint8_t data[ELLISYS_HDR_SIZE + BTSNOOP_MAX_PACKET_SIZE];
+};
+
 static int ellisys_fd = -1;
 static uint16_t ellisys_index = 0xffff;
+static enum ellisys_policy ellisys_policy = ELLISYS_BLOCK;
+
+static struct ellisys_slot *ring = NULL;
+static unsigned int ring_head = 0;
+static unsigned int ring_count = 0;
+static bool sender_busy = false;
+static bool sender_quit = false;
+static pthread_t sender_thread;
+static pthread_mutex_t sender_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sender_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned long datagrams_sent = 0;
+static unsigned long send_errors = 0;
+static unsigned long queue_drops = 0;
+static unsigned long size_drops = 0;
+static unsigned long send_calls = 0;
+
+static unsigned int send_batch(unsigned int head, unsigned int count)
+{
+	struct mmsghdr msgs[ELLISYS_BATCH_SIZE];
+	struct iovec iov[ELLISYS_BATCH_SIZE];
+	unsigned int i;
+	int sent;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < count; i++) {
+		struct ellisys_slot *slot;
+
+		slot = &ring[(head + i) % ELLISYS_QUEUE_SIZE];
+
+		iov[i].iov_base = slot->data;
+		iov[i].iov_len = slot->len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	sent = sendmmsg(ellisys_fd, msgs, count, 0);
+
+	send_calls++;
+
+	/* Skip the datagram that failed so one bad send cannot wedge us */
+	if (sent <= 0) {
+		send_errors++;
+		return 1;
+	}
 
-void ellisys_enable(const char *server, uint16_t port)
+	datagrams_sent += sent;
+
+	return sent;
+}
+
+static void *sender_func(void *user_data)
+{
+	unsigned int head, count, done;
+
+	pthread_mutex_lock(&sender_lock);
+
+	while (1) {
+		while (!ring_count && !sender_quit)
+			pthread_cond_wait(&sender_cond, &sender_lock);
+
+		if (!ring_count)
+			break;
+
+		/* Slots up to the end of the ring, at most one batch */
+		head = ring_head;
+		count = ring_count;
+		if (count > ELLISYS_QUEUE_SIZE - head)
+			count = ELLISYS_QUEUE_SIZE - head;
+		if (count > ELLISYS_BATCH_SIZE)
+			count = ELLISYS_BATCH_SIZE;
+
+		sender_busy = true;
+
+		pthread_mutex_unlock(&sender_lock);
+
+		done = send_batch(head, count);
+
+		pthread_mutex_lock(&sender_lock);
+
+		ring_head = (ring_head + done) % ELLISYS_QUEUE_SIZE;
+		ring_count -= done;
+		sender_busy = false;
+
+		pthread_cond_broadcast(&sender_cond);
+	}
+
+	pthread_mutex_unlock(&sender_lock);
+
+	return NULL;
+}
+
+void ellisys_enable(const char *server, uint16_t port,
+						enum ellisys_policy policy)
 {
 	struct sockaddr_in addr;
 	int fd;
@@ -70,7 +183,54 @@ void ellisys_enable(const char *server, uint16_t port)
 		return;
 	}
 
+	ring = calloc(ELLISYS_QUEUE_SIZE, sizeof(*ring));
+	if (!ring) {
+		close(fd);
+		return;
+	}
+
 	ellisys_fd = fd;
+	ellisys_policy = policy;
+
+	if (pthread_create(&sender_thread, NULL, sender_func, NULL)) {
+		perror("Failed to start Ellisys injection thread");
+		free(ring);
+		ring = NULL;
+		close(fd);
+		ellisys_fd = -1;
+	}
+}
+
+void ellisys_disable(void)
+{
+	if (ellisys_fd < 0)
+		return;
+
+	/* Let the sender drain what is queued before it exits */
+	pthread_mutex_lock(&sender_lock);
+	sender_quit = true;
+	pthread_cond_broadcast(&sender_cond);
+	pthread_mutex_unlock(&sender_lock);
+
+	pthread_join(sender_thread, NULL);
+
+	close(ellisys_fd);
+	ellisys_fd = -1;
+
+	free(ring);
+	ring = NULL;
+}
+
+void ellisys_print_stats(void)
+{
+	if (!send_calls && !queue_drops && !size_drops)
+		return;
+
+	printf("Ellisys injection: %lu datagrams in %lu send calls, "
+				"%lu send errors, %lu queue drops, "
+				"%lu oversized drops\n",
+				datagrams_sent, send_calls, send_errors,
+				queue_drops, size_drops);
 }
 
 void ellisys_inject_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
@@ -90,10 +250,8 @@ void ellisys_inject_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
 		0x82
 	};
 	long nsec;
-	time_t t;
-	struct tm tm;
-	struct iovec iov[2];
-	int iovcnt;
+	const struct tm *tm;
+	struct ellisys_slot *slot;
 
 	if (!tv)
 		return;
@@ -107,16 +265,16 @@ void ellisys_inject_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
 	if (index != ellisys_index)
 		return;
 
-	t = tv->tv_sec;
-	localtime_r(&t, &tm);
+	/* Shares the per-second local time with the packet headers */
+	tm = packet_local_time(tv->tv_sec);
 
-	nsec = ((tm.tm_sec + (tm.tm_min * 60) +
-			(tm.tm_hour * 3600)) * 1000000l + tv->tv_usec) * 1000l;
+	nsec = ((tm->tm_sec + (tm->tm_min * 60) +
+			(tm->tm_hour * 3600)) * 1000000l + tv->tv_usec) * 1000l;
 
-	msg[4]  = (1900 + tm.tm_year) & 0xff;
-	msg[5]  = (1900 + tm.tm_year) >> 8;
-	msg[6]  = (tm.tm_mon + 1) & 0xff;
-	msg[7]  = tm.tm_mday & 0xff;
+	msg[4]  = (1900 + tm->tm_year) & 0xff;
+	msg[5]  = (1900 + tm->tm_year) >> 8;
+	msg[6]  = (tm->tm_mon + 1) & 0xff;
+	msg[7]  = tm->tm_mday & 0xff;
 	msg[8]  = (nsec & 0x0000000000ffl);
 	msg[9]  = (nsec & 0x00000000ff00l) >> 8;
 	msg[10] = (nsec & 0x000000ff0000l) >> 16;
@@ -147,16 +305,38 @@ void ellisys_inject_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
 		return;
 	}
 
-	iov[0].iov_base = msg;
-	iov[0].iov_len  = sizeof(msg);
+	pthread_mutex_lock(&sender_lock);
+
+	/* Slots only hold packets up to the btsnoop maximum */
+	if (size > BTSNOOP_MAX_PACKET_SIZE) {
+		size_drops++;
+		pthread_mutex_unlock(&sender_lock);
+		return;
+	}
+
+	if (ellisys_policy == ELLISYS_BLOCK) {
+		while (ring_count == ELLISYS_QUEUE_SIZE)
+			pthread_cond_wait(&sender_cond, &sender_lock);
+	} else if (ring_count == ELLISYS_QUEUE_SIZE) {
+		queue_drops++;
+		pthread_mutex_unlock(&sender_lock);
+		return;
+	}
+
+	slot = &ring[(ring_head + ring_count) % ELLISYS_QUEUE_SIZE];
+
+	pthread_mutex_unlock(&sender_lock);
+
+	/* The tail slot is invisible to the sender until it is counted */
+	memcpy(slot->data, msg, sizeof(msg));
+	memcpy(slot->data + sizeof(msg), data, size);
+	slot->len = sizeof(msg) + size;
+
+	pthread_mutex_lock(&sender_lock);
 
-	if (size > 0) {
-		iov[1].iov_base = (void *) data;
-		iov[1].iov_len  = size;
-		iovcnt = 2;
-	} else
-		iovcnt = 1;
+	ring_count++;
+	if (!sender_busy)
+		pthread_cond_signal(&sender_cond);
 
-	if (writev(ellisys_fd, iov, iovcnt) < 0)
-		perror("Failed to send Ellisys injection packet");
+	pthread_mutex_unlock(&sender_lock);
 }
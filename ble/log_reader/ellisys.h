@@ -24,7 +24,16 @@
 
 #include <stdint.h>
 
-void ellisys_enable(const char *server, uint16_t port);
+/* What to do with a datagram when the send queue is full */
+enum ellisys_policy {
+	ELLISYS_BLOCK,
+	ELLISYS_DROP,
+};
+
+void ellisys_enable(const char *server, uint16_t port,
+						enum ellisys_policy policy);
+void ellisys_disable(void);
+void ellisys_print_stats(void);
 
 void ellisys_inject_hci(struct timeval *tv, uint16_t index, uint16_t opcode,
 					const void *data, uint16_t size);
@@ -0,0 +1,528 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/mainloop.h"
+
+#include "fanout.h"
+
+/*
+ * Live packets are handed to any number of local consumers connected to
+ * the fan-out socket. Every packet is framed once with the same header
+ * the monitor server socket uses (opcode, index, length; little endian)
+ * and shared by reference between the per-client rings, so a slow
+ * consumer only ever fills its own ring. What happens when a ring is
+ * full is decided by the overflow policy.
+ *
+ * A client can ask for its counters by sending a header with opcode
+ * FANOUT_OPCODE_STATS; the answer is queued as a system note packet.
+ */
+#define FANOUT_HDR_SIZE		6
+#define FANOUT_MAX_IOV		64
+
+#define FANOUT_OPCODE_STATS	0xffff
+
+struct fanout_pkt {
+	unsigned int ref;
+	uint16_t len;
+	uint8_t data[];
+};
+
+struct fanout_client {
+	int fd;
+	struct fanout_pkt **ring;
+	unsigned int head;
+	unsigned int count;
+	size_t sent;
+	bool writing;
+	bool overflow;
+	uint8_t req[FANOUT_HDR_SIZE];
+	uint8_t req_len;
+	uint16_t req_skip;
+	unsigned long packets;
+	uint64_t bytes;
+	unsigned int max_lag;
+	unsigned long drops;
+};
+
+static int fanout_fd = -1;
+static struct queue *client_list = NULL;
+static unsigned int ring_size = FANOUT_DEFAULT_QUEUE;
+static enum fanout_policy overflow_policy = FANOUT_DROP_OLDEST;
+static unsigned long total_clients = 0;
+static unsigned long total_disconnects = 0;
+
+static struct fanout_pkt *pkt_new(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	struct fanout_pkt *pkt;
+
+	pkt = malloc(sizeof(*pkt) + FANOUT_HDR_SIZE + size);
+	if (!pkt)
+		return NULL;
+
+	pkt->ref = 0;
+	pkt->len = FANOUT_HDR_SIZE + size;
+
+	put_le16(opcode, pkt->data);
+	put_le16(index, pkt->data + 2);
+	put_le16(size, pkt->data + 4);
+	memcpy(pkt->data + FANOUT_HDR_SIZE, data, size);
+
+	return pkt;
+}
+
+static void pkt_unref(struct fanout_pkt *pkt)
+{
+	if (--pkt->ref == 0)
+		free(pkt);
+}
+
+static struct fanout_pkt *ring_at(struct fanout_client *client,
+							unsigned int pos)
+{
+	return client->ring[(client->head + pos) % ring_size];
+}
+
+static void client_free(void *user_data)
+{
+	struct fanout_client *client = user_data;
+
+	queue_remove(client_list, client);
+
+	while (client->count) {
+		pkt_unref(ring_at(client, 0));
+		client->head = (client->head + 1) % ring_size;
+		client->count--;
+	}
+
+	close(client->fd);
+
+	free(client->ring);
+	free(client);
+}
+
+static void client_flush(struct fanout_client *client)
+{
+	struct iovec iov[FANOUT_MAX_IOV];
+	struct msghdr msg;
+	unsigned int i, n;
+	ssize_t len;
+
+	while (client->count) {
+		n = client->count < FANOUT_MAX_IOV ?
+					client->count : FANOUT_MAX_IOV;
+
+		for (i = 0; i < n; i++) {
+			struct fanout_pkt *pkt = ring_at(client, i);
+
+			iov[i].iov_base = pkt->data;
+			iov[i].iov_len = pkt->len;
+		}
+
+		iov[0].iov_base += client->sent;
+		iov[0].iov_len -= client->sent;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+
+		len = sendmsg(client->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		client->bytes += len;
+
+		/* Release every packet that went out completely */
+		while (client->count) {
+			struct fanout_pkt *pkt = ring_at(client, 0);
+			size_t left = pkt->len - client->sent;
+
+			if ((size_t) len < left) {
+				client->sent += len;
+				break;
+			}
+
+			len -= left;
+			client->sent = 0;
+			client->packets++;
+
+			pkt_unref(pkt);
+			client->head = (client->head + 1) % ring_size;
+			client->count--;
+		}
+
+		if (client->sent)
+			break;
+	}
+
+	if (client->count && !client->writing) {
+		mainloop_modify_fd(client->fd, EPOLLIN | EPOLLOUT);
+		client->writing = true;
+	} else if (!client->count && client->writing) {
+		mainloop_modify_fd(client->fd, EPOLLIN);
+		client->writing = false;
+	}
+}
+
+static void client_push(struct fanout_client *client, struct fanout_pkt *pkt)
+{
+	unsigned int victim, pos;
+
+	if (client->overflow)
+		return;
+
+	if (client->count == ring_size) {
+		client->drops++;
+
+		if (overflow_policy == FANOUT_DISCONNECT) {
+			client->overflow = true;
+			return;
+		}
+
+		/* A partially written packet has to stay at the head */
+		victim = client->sent ? 1 : 0;
+
+		pkt_unref(ring_at(client, victim));
+
+		if (victim) {
+			pos = (client->head + 1) % ring_size;
+			client->ring[pos] = client->ring[client->head];
+		}
+
+		client->head = (client->head + 1) % ring_size;
+		client->count--;
+	}
+
+	pos = (client->head + client->count) % ring_size;
+	client->ring[pos] = pkt;
+	client->count++;
+	pkt->ref++;
+
+	if (client->count > client->max_lag)
+		client->max_lag = client->count;
+
+	if (!client->writing) {
+		mainloop_modify_fd(client->fd, EPOLLIN | EPOLLOUT);
+		client->writing = true;
+	}
+}
+
+struct push_data {
+	struct fanout_pkt *pkt;
+	bool overflow;
+};
+
+static void push_client(void *data, void *user_data)
+{
+	struct fanout_client *client = data;
+	struct push_data *push = user_data;
+
+	client_push(client, push->pkt);
+
+	if (client->overflow)
+		push->overflow = true;
+}
+
+static bool match_overflow(const void *data, const void *match_data)
+{
+	const struct fanout_client *client = data;
+
+	return client->overflow;
+}
+
+static void disconnect_client(void *data)
+{
+	struct fanout_client *client = data;
+
+	total_disconnects++;
+
+	mainloop_remove_fd(client->fd);
+}
+
+void fanout_hci(uint16_t index, uint16_t opcode, const void *data,
+								uint16_t size)
+{
+	struct push_data push = { };
+
+	if (queue_isempty(client_list))
+		return;
+
+	push.pkt = pkt_new(index, opcode, data, size);
+	if (!push.pkt)
+		return;
+
+	/* Hold a reference so clients releasing theirs cannot free it */
+	push.pkt->ref++;
+
+	queue_foreach(client_list, push_client, &push);
+
+	if (push.overflow)
+		queue_remove_all(client_list, match_overflow, NULL,
+							disconnect_client);
+
+	pkt_unref(push.pkt);
+}
+
+static void send_stats(struct fanout_client *client)
+{
+	struct fanout_pkt *pkt;
+	char str[160];
+	int len;
+
+	len = snprintf(str, sizeof(str), "packets %lu bytes %" PRIu64
+				" queued %u max-lag %u drops %lu",
+				client->packets, client->bytes,
+				client->count, client->max_lag,
+				client->drops);
+
+	pkt = pkt_new(0xffff, BTSNOOP_OPCODE_SYSTEM_NOTE, str, len + 1);
+	if (!pkt)
+		return;
+
+	pkt->ref++;
+	client_push(client, pkt);
+	pkt_unref(pkt);
+}
+
+static bool client_read(struct fanout_client *client)
+{
+	uint8_t buf[256];
+	ssize_t len;
+	uint8_t *ptr;
+
+	len = recv(client->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (len < 0)
+		return true;
+
+	if (!len) {
+		mainloop_remove_fd(client->fd);
+		return false;
+	}
+
+	ptr = buf;
+
+	while (len > 0) {
+		size_t count;
+
+		if (client->req_skip) {
+			count = client->req_skip < len ? client->req_skip : len;
+			client->req_skip -= count;
+			ptr += count;
+			len -= count;
+			continue;
+		}
+
+		count = FANOUT_HDR_SIZE - client->req_len;
+		if (count > (size_t) len)
+			count = len;
+
+		memcpy(client->req + client->req_len, ptr, count);
+		client->req_len += count;
+		ptr += count;
+		len -= count;
+
+		if (client->req_len < FANOUT_HDR_SIZE)
+			break;
+
+		client->req_len = 0;
+		client->req_skip = get_le16(client->req + 4);
+
+		if (get_le16(client->req) == FANOUT_OPCODE_STATS)
+			send_stats(client);
+	}
+
+	return true;
+}
+
+static void client_callback(int fd, uint32_t events, void *user_data)
+{
+	struct fanout_client *client = user_data;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		mainloop_remove_fd(client->fd);
+		return;
+	}
+
+	if ((events & EPOLLIN) && !client_read(client))
+		return;
+
+	if (events & EPOLLOUT)
+		client_flush(client);
+}
+
+static void server_callback(int fd, uint32_t events, void *user_data)
+{
+	struct fanout_client *client;
+	int nfd;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		mainloop_remove_fd(fd);
+		return;
+	}
+
+	nfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (nfd < 0) {
+		perror("Failed to accept fan-out client");
+		return;
+	}
+
+	client = new0(struct fanout_client, 1);
+	if (!client) {
+		close(nfd);
+		return;
+	}
+
+	client->fd = nfd;
+	client->ring = new0(struct fanout_pkt *, ring_size);
+	if (!client->ring) {
+		free(client);
+		close(nfd);
+		return;
+	}
+
+	if (!queue_push_tail(client_list, client)) {
+		free(client->ring);
+		free(client);
+		close(nfd);
+		return;
+	}
+
+	if (mainloop_add_fd(nfd, EPOLLIN, client_callback, client,
+							client_free) < 0) {
+		client_free(client);
+		return;
+	}
+
+	total_clients++;
+}
+
+bool fanout_open(const char *path, unsigned int queue_size,
+						enum fanout_policy policy)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (fanout_fd >= 0)
+		return true;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return false;
+
+	ring_size = queue_size < 2 ? 2 : queue_size;
+	overflow_policy = policy;
+
+	client_list = queue_new();
+
+	unlink(path);
+
+	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("Failed to open fan-out socket");
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("Failed to bind fan-out socket");
+		close(fd);
+		return false;
+	}
+
+	if (listen(fd, 5) < 0) {
+		perror("Failed to listen fan-out socket");
+		close(fd);
+		return false;
+	}
+
+	if (mainloop_add_fd(fd, EPOLLIN, server_callback, NULL, NULL) < 0) {
+		close(fd);
+		return false;
+	}
+
+	fanout_fd = fd;
+
+	return true;
+}
+
+static void print_client(void *data, void *user_data)
+{
+	struct fanout_client *client = data;
+
+	printf("  Client %d: %lu packets, %" PRIu64 " bytes, %u queued, "
+				"max lag %u, %lu dropped\n", client->fd,
+				client->packets, client->bytes,
+				client->count, client->max_lag,
+				client->drops);
+}
+
+void fanout_print_stats(void)
+{
+	if (fanout_fd < 0)
+		return;
+
+	printf("Fan-out: %lu clients, %lu disconnected on overflow\n",
+				total_clients, total_disconnects);
+
+	queue_foreach(client_list, print_client, NULL);
+}
+
+static void remove_client(void *data)
+{
+	struct fanout_client *client = data;
+
+	mainloop_remove_fd(client->fd);
+}
+
+void fanout_close(void)
+{
+	if (fanout_fd < 0)
+		return;
+
+	queue_remove_all(client_list, NULL, NULL, remove_client);
+	queue_destroy(client_list, NULL);
+	client_list = NULL;
+
+	mainloop_remove_fd(fanout_fd);
+	close(fanout_fd);
+	fanout_fd = -1;
+}
@@ -0,0 +1,38 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FANOUT_DEFAULT_QUEUE	4096
+
+enum fanout_policy {
+	FANOUT_DROP_OLDEST,
+	FANOUT_DISCONNECT,
+};
+
+bool fanout_open(const char *path, unsigned int queue_size,
+						enum fanout_policy policy);
+void fanout_close(void);
+
+void fanout_hci(uint16_t index, uint16_t opcode, const void *data,
+							uint16_t size);
+
+void fanout_print_stats(void);
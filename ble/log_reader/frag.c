@@ -0,0 +1,123 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frag.h"
+
+/*
+ * Reassembly buffers are served from power-of-four size classes and
+ * returned to a small per-class free list once the PDU is complete, so
+ * long fragmented transfers reuse the same few buffers.
+ */
+#define FRAG_POOL_CLASSES	6
+#define FRAG_POOL_DEPTH		16
+
+static const uint32_t frag_class_size[FRAG_POOL_CLASSES] = {
+	64, 256, 1024, 4096, 16384, 65536
+};
+
+static struct {
+	void *buf[FRAG_POOL_DEPTH];
+	uint8_t count;
+} frag_pool[FRAG_POOL_CLASSES];
+
+static unsigned long frag_pool_allocs = 0;
+static unsigned long frag_pool_reuses = 0;
+
+static void *frag_buf_get(uint32_t len, uint8_t *buf_class)
+{
+	uint8_t i;
+	void *buf;
+
+	for (i = 0; frag_class_size[i] < len; i++);
+
+	*buf_class = i;
+
+	if (frag_pool[i].count) {
+		frag_pool_reuses++;
+		return frag_pool[i].buf[--frag_pool[i].count];
+	}
+
+	buf = malloc(frag_class_size[i]);
+	if (buf)
+		frag_pool_allocs++;
+
+	return buf;
+}
+
+static void frag_buf_put(void *buf, uint8_t buf_class)
+{
+	if (frag_pool[buf_class].count == FRAG_POOL_DEPTH) {
+		free(buf);
+		return;
+	}
+
+	frag_pool[buf_class].buf[frag_pool[buf_class].count++] = buf;
+}
+
+bool frag_start(struct frag_data *frag, uint16_t cid, uint32_t len)
+{
+	if (len > UINT16_MAX)
+		return false;
+
+	frag->buf = frag_buf_get(len, &frag->buf_class);
+	if (!frag->buf)
+		return false;
+
+	frag->pos = 0;
+	frag->len = len;
+	frag->cid = cid;
+
+	return true;
+}
+
+bool frag_append(struct frag_data *frag, const void *data, uint16_t size)
+{
+	if (size > frag->len)
+		return false;
+
+	memcpy(frag->buf + frag->pos, data, size);
+	frag->pos += size;
+	frag->len -= size;
+
+	return true;
+}
+
+void frag_clear(struct frag_data *frag)
+{
+	if (frag->buf)
+		frag_buf_put(frag->buf, frag->buf_class);
+
+	frag->buf = NULL;
+	frag->pos = 0;
+	frag->len = 0;
+}
+
+void frag_get_stats(unsigned long *allocs, unsigned long *reuses)
+{
+	*allocs = frag_pool_allocs;
+	*reuses = frag_pool_reuses;
+}
@@ -0,0 +1,40 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Reassembly state for one direction of a connection. pos is the
+ * number of bytes collected so far and len the number still missing.
+ */
+struct frag_data {
+	void *buf;
+	uint8_t buf_class;
+	uint16_t pos;
+	uint16_t len;
+	uint16_t cid;
+};
+
+bool frag_start(struct frag_data *frag, uint16_t cid, uint32_t len);
+bool frag_append(struct frag_data *frag, const void *data, uint16_t size);
+void frag_clear(struct frag_data *frag);
+
+void frag_get_stats(unsigned long *allocs, unsigned long *reuses);
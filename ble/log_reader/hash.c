@@ -0,0 +1,218 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "hash.h"
+
+/*
+ * Open-addressed table with linear probing. Entries are removed with
+ * backward shift deletion, so a probe sequence always ends at the first
+ * empty slot and no tombstones are needed. The load factor is kept at
+ * or below one half.
+ */
+
+#define HASH_MIN_SIZE	16
+
+struct hash_entry {
+	uint64_t key;
+	void *value;
+};
+
+struct hash {
+	struct hash_entry *entries;
+	uint32_t mask;
+	uint32_t count;
+};
+
+static inline uint32_t hash_key(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+static uint32_t hash_find(const struct hash *hash, uint64_t key)
+{
+	uint32_t i = hash_key(key) & hash->mask;
+
+	while (hash->entries[i].value && hash->entries[i].key != key)
+		i = (i + 1) & hash->mask;
+
+	return i;
+}
+
+static bool hash_resize(struct hash *hash, uint32_t size)
+{
+	struct hash_entry *entries = hash->entries;
+	uint32_t old_size = hash->mask + 1;
+	uint32_t i;
+
+	hash->entries = calloc(size, sizeof(*entries));
+	if (!hash->entries) {
+		hash->entries = entries;
+		return false;
+	}
+
+	hash->mask = size - 1;
+
+	for (i = 0; i < old_size; i++) {
+		if (entries[i].value)
+			hash->entries[hash_find(hash, entries[i].key)] =
+								entries[i];
+	}
+
+	free(entries);
+
+	return true;
+}
+
+struct hash *hash_new(void)
+{
+	struct hash *hash;
+
+	hash = calloc(1, sizeof(*hash));
+	if (!hash)
+		return NULL;
+
+	hash->entries = calloc(HASH_MIN_SIZE, sizeof(*hash->entries));
+	if (!hash->entries) {
+		free(hash);
+		return NULL;
+	}
+
+	hash->mask = HASH_MIN_SIZE - 1;
+
+	return hash;
+}
+
+void hash_destroy(struct hash *hash, hash_destroy_func_t destroy)
+{
+	uint32_t i;
+
+	if (!hash)
+		return;
+
+	if (destroy) {
+		for (i = 0; i <= hash->mask; i++) {
+			if (hash->entries[i].value)
+				destroy(hash->entries[i].value);
+		}
+	}
+
+	free(hash->entries);
+	free(hash);
+}
+
+bool hash_insert(struct hash *hash, uint64_t key, void *value)
+{
+	uint32_t i;
+
+	if (!hash || !value)
+		return false;
+
+	i = hash_find(hash, key);
+	if (hash->entries[i].value) {
+		hash->entries[i].value = value;
+		return true;
+	}
+
+	if ((hash->count + 1) * 2 > hash->mask + 1) {
+		if (!hash_resize(hash, (hash->mask + 1) * 2))
+			return false;
+
+		i = hash_find(hash, key);
+	}
+
+	hash->entries[i].key = key;
+	hash->entries[i].value = value;
+	hash->count++;
+
+	return true;
+}
+
+void *hash_lookup(struct hash *hash, uint64_t key)
+{
+	if (!hash)
+		return NULL;
+
+	return hash->entries[hash_find(hash, key)].value;
+}
+
+void *hash_remove(struct hash *hash, uint64_t key)
+{
+	uint32_t i, j, k;
+	void *value;
+
+	if (!hash)
+		return NULL;
+
+	i = hash_find(hash, key);
+	value = hash->entries[i].value;
+	if (!value)
+		return NULL;
+
+	hash->entries[i].value = NULL;
+	hash->count--;
+
+	for (j = (i + 1) & hash->mask; hash->entries[j].value;
+						j = (j + 1) & hash->mask) {
+		k = hash_key(hash->entries[j].key) & hash->mask;
+
+		/* Leave entries whose home slot lies within (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		hash->entries[i] = hash->entries[j];
+		hash->entries[j].value = NULL;
+		i = j;
+	}
+
+	return value;
+}
+
+void hash_foreach(struct hash *hash, hash_foreach_func_t function,
+							void *user_data)
+{
+	uint32_t i;
+
+	if (!hash || !function)
+		return;
+
+	for (i = 0; i <= hash->mask; i++) {
+		if (hash->entries[i].value)
+			function(hash->entries[i].key, hash->entries[i].value,
+								user_data);
+	}
+}
+
+unsigned int hash_count(struct hash *hash)
+{
+	if (!hash)
+		return 0;
+
+	return hash->count;
+}
@@ -0,0 +1,39 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*hash_destroy_func_t)(void *value);
+typedef void (*hash_foreach_func_t)(uint64_t key, void *value,
+							void *user_data);
+
+struct hash;
+
+struct hash *hash_new(void);
+void hash_destroy(struct hash *hash, hash_destroy_func_t destroy);
+
+bool hash_insert(struct hash *hash, uint64_t key, void *value);
+void *hash_lookup(struct hash *hash, uint64_t key);
+void *hash_remove(struct hash *hash, uint64_t key);
+
+void hash_foreach(struct hash *hash, hash_foreach_func_t function,
+							void *user_data);
+unsigned int hash_count(struct hash *hash);
@@ -0,0 +1,106 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "hex.h"
+
+/*
+ * Hex and printable character lookup tables for the address and hexdump
+ * formatters. The printable table is derived from isprint() so the
+ * output stays the same as the per-byte version.
+ */
+static char hex_upper[256][2];
+static char hex_lower[256][2];
+static char hex_ascii[256];
+static bool hex_tables_ready = false;
+
+/*
+ * Tables are filled in on first use. Callers formatting from more than
+ * one thread call this once before starting them.
+ */
+void hex_init(void)
+{
+	static const char upper[] = "0123456789ABCDEF";
+	static const char lower[] = "0123456789abcdef";
+	int i;
+
+	if (hex_tables_ready)
+		return;
+
+	for (i = 0; i < 256; i++) {
+		hex_upper[i][0] = upper[i >> 4];
+		hex_upper[i][1] = upper[i & 0xf];
+		hex_lower[i][0] = lower[i >> 4];
+		hex_lower[i][1] = lower[i & 0xf];
+		hex_ascii[i] = isprint(i) ? i : '.';
+	}
+
+	hex_tables_ready = true;
+}
+
+void hex_row(const uint8_t *buf, unsigned int len, char *str)
+{
+	unsigned int i;
+
+	if (!hex_tables_ready)
+		hex_init();
+
+	if (len > HEX_ROW_BYTES)
+		len = HEX_ROW_BYTES;
+
+	for (i = 0; i < len; i++) {
+		memcpy(str + i * 3, hex_lower[buf[i]], 2);
+		str[i * 3 + 2] = ' ';
+		str[i + 49] = hex_ascii[buf[i]];
+	}
+
+	for (; i < HEX_ROW_BYTES; i++) {
+		memset(str + i * 3, ' ', 3);
+		str[i + 49] = ' ';
+	}
+
+	str[47] = ' ';
+	str[48] = ' ';
+	str[65] = '\0';
+}
+
+int hex_addr2str(const uint8_t *addr, char *str)
+{
+	int i;
+
+	if (!hex_tables_ready)
+		hex_init();
+
+	for (i = 0; i < 6; i++) {
+		memcpy(str + i * 3, hex_upper[addr[5 - i]], 2);
+		str[i * 3 + 2] = ':';
+	}
+
+	str[17] = '\0';
+
+	return 17;
+}
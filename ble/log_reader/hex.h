@@ -0,0 +1,33 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+
+/*
+ * Hexdump rows hold up to HEX_ROW_BYTES bytes as hex pairs, two spaces
+ * and the printable characters, padded to the full row width.
+ */
+#define HEX_ROW_BYTES	16
+#define HEX_ROW_SIZE	66
+#define HEX_ADDR_SIZE	18
+
+void hex_init(void);
+void hex_row(const uint8_t *buf, unsigned int len, char *str);
+int hex_addr2str(const uint8_t *addr, char *str);
@@ -32,6 +32,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/crypto.h"
 
+#include "checkpoint.h"
 #include "keys.h"
 
 static const uint8_t empty_key[16] = { 0x00, };
@@ -125,3 +126,39 @@ bool keys_resolve_identity(const uint8_t addr[6], uint8_t ident[6],
 
 	return false;
 }
+
+static void save_irk(void *data, void *user_data)
+{
+	checkpoint_put(user_data, data, sizeof(struct irk_data));
+}
+
+void keys_save_state(struct checkpoint *ckpt)
+{
+	checkpoint_put_u32(ckpt, queue_length(irk_list));
+	queue_foreach(irk_list, save_irk, ckpt);
+}
+
+bool keys_restore_state(struct checkpoint *ckpt)
+{
+	struct irk_data *irk;
+	uint32_t i, count;
+
+	queue_remove_all(irk_list, NULL, NULL, free);
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		irk = new0(struct irk_data, 1);
+		if (!irk)
+			return false;
+
+		if (!checkpoint_get(ckpt, irk, sizeof(*irk)) ||
+					!queue_push_tail(irk_list, irk)) {
+			free(irk);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -33,3 +33,8 @@ void keys_update_identity_addr(const uint8_t addr[6], uint8_t addr_type);
 
 bool keys_resolve_identity(const uint8_t addr[6], uint8_t ident[6],
 							uint8_t *ident_type);
+
+struct checkpoint;
+
+void keys_save_state(struct checkpoint *ckpt);
+bool keys_restore_state(struct checkpoint *ckpt);
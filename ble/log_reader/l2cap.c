@@ -34,10 +34,16 @@
 #include "lib/bluetooth.h"
 
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 #include "bt.h"
 #include "packet.h"
 #include "display.h"
 #include "l2cap.h"
+#include "hash.h"
+#include "frag.h"
+#include "checkpoint.h"
+#include "att.h"
+#include "stats.h"
 #include "uuid.h"
 #include "keys.h"
 #include "sdp.h"
@@ -88,8 +94,6 @@
 #define L2CAP_SAR_END		0x02
 #define L2CAP_SAR_CONTINUE	0x03
 
-#define MAX_CHAN 64
-
 struct chan_data {
 	uint16_t index;
 	uint16_t handle;
@@ -101,259 +105,535 @@ struct chan_data {
 	uint8_t  mode;
 	uint8_t  ext_ctrl;
 	uint8_t  seq_num;
+	uint16_t chan;
 };
 
-static struct chan_data chan_list[MAX_CHAN];
+struct conn_data {
+	uint16_t index;
+	uint16_t handle;
+	struct queue *chan_list;
+	struct frag_data frag[2];
+};
 
-static void assign_scid(const struct l2cap_frame *frame,
-				uint16_t scid, uint16_t psm, uint8_t ctrlid)
+/* Connections keyed by (index, handle) for the signalling slow path */
+static struct hash *conn_hash = NULL;
+
+/* Channels keyed by (data index, handle, direction, cid) for data frames */
+static struct hash *chan_hash = NULL;
+
+static uint16_t chan_next = 0;
+
+static inline uint64_t conn_key(uint16_t index, uint16_t handle)
 {
-	int i, n = -1;
-	uint8_t seq_num = 1;
+	return ((uint64_t) index << 16) | handle;
+}
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (n < 0 && chan_list[i].handle == 0x0000) {
-			n = i;
-			continue;
-		}
+static inline uint64_t chan_key(uint16_t index, uint16_t handle, bool in,
+								uint16_t cid)
+{
+	return ((uint64_t) index << 33) | ((uint64_t) in << 32) |
+					((uint64_t) handle << 16) | cid;
+}
 
-		if (chan_list[i].index != frame->index)
-			continue;
+static void chan_hash_add(struct chan_data *chan)
+{
+	uint16_t index = chan->ctrlid ? chan->ctrlid : chan->index;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	if (chan->scid)
+		hash_insert(chan_hash, chan_key(index, chan->handle, true,
+							chan->scid), chan);
 
-		if (chan_list[i].psm == psm)
-			seq_num++;
+	if (chan->dcid)
+		hash_insert(chan_hash, chan_key(index, chan->handle, false,
+							chan->dcid), chan);
+}
 
-		/* Don't break on match - we still need to go through all
-		 * channels to find proper seq_num.
-		 */
-		if (frame->in) {
-			if (chan_list[i].dcid == scid)
-				n = i;
-		} else {
-			if (chan_list[i].scid == scid)
-				n = i;
-		}
+static void chan_hash_del(struct chan_data *chan)
+{
+	uint16_t index = chan->ctrlid ? chan->ctrlid : chan->index;
+	uint64_t key;
+
+	/* Only drop keys that have not been taken over by a newer channel */
+	key = chan_key(index, chan->handle, true, chan->scid);
+	if (chan->scid && hash_lookup(chan_hash, key) == chan)
+		hash_remove(chan_hash, key);
+
+	key = chan_key(index, chan->handle, false, chan->dcid);
+	if (chan->dcid && hash_lookup(chan_hash, key) == chan)
+		hash_remove(chan_hash, key);
+}
+
+static void chan_free(void *data)
+{
+	struct chan_data *chan = data;
+
+	chan_hash_del(chan);
+	free(chan);
+}
+
+static struct conn_data *get_conn_data(uint16_t index, uint16_t handle,
+								bool create)
+{
+	struct conn_data *conn;
+
+	if (!conn_hash) {
+		if (!create)
+			return NULL;
+
+		conn_hash = hash_new();
+		chan_hash = hash_new();
+	}
+
+	conn = hash_lookup(conn_hash, conn_key(index, handle));
+	if (conn || !create)
+		return conn;
+
+	conn = new0(struct conn_data, 1);
+	if (!conn)
+		return NULL;
+
+	conn->index = index;
+	conn->handle = handle;
+	conn->chan_list = queue_new();
+
+	if (!hash_insert(conn_hash, conn_key(index, handle), conn)) {
+		queue_destroy(conn->chan_list, NULL);
+		free(conn);
+		return NULL;
 	}
 
-	if (n < 0)
+	return conn;
+}
+
+static void conn_free(void *data)
+{
+	struct conn_data *conn = data;
+
+	frag_clear(&conn->frag[0]);
+	frag_clear(&conn->frag[1]);
+
+	queue_destroy(conn->chan_list, chan_free);
+	free(conn);
+}
+
+void l2cap_release_conn(uint16_t index, uint16_t handle)
+{
+	struct conn_data *conn;
+
+	conn = hash_remove(conn_hash, conn_key(index, handle));
+	if (conn)
+		conn_free(conn);
+}
+
+static void save_frag(struct checkpoint *ckpt, const struct frag_data *frag)
+{
+	checkpoint_put(ckpt, &frag->pos, sizeof(frag->pos));
+	checkpoint_put(ckpt, &frag->len, sizeof(frag->len));
+	checkpoint_put(ckpt, &frag->cid, sizeof(frag->cid));
+
+	if (frag->len)
+		checkpoint_put(ckpt, frag->buf, frag->pos);
+}
+
+static bool restore_frag(struct checkpoint *ckpt, struct frag_data *frag)
+{
+	uint16_t pos, len, cid;
+
+	if (!checkpoint_get(ckpt, &pos, sizeof(pos)) ||
+			!checkpoint_get(ckpt, &len, sizeof(len)) ||
+			!checkpoint_get(ckpt, &cid, sizeof(cid)))
+		return false;
+
+	if (!len)
+		return true;
+
+	if (!frag_start(frag, cid, pos + len))
+		return false;
+
+	if (!checkpoint_get(ckpt, frag->buf, pos))
+		return false;
+
+	frag->pos = pos;
+	frag->len = len;
+
+	return true;
+}
+
+/*
+ * Channels are referenced from both the per-connection lists and the
+ * data path hash, so they are written once in list order and the hash
+ * refers to them by their position in the snapshot.
+ */
+struct save_data {
+	struct checkpoint *ckpt;
+	struct hash *chan_pos;
+	uint32_t count;
+};
+
+static void save_chan(void *data, void *user_data)
+{
+	struct save_data *save = user_data;
+
+	checkpoint_put(save->ckpt, data, sizeof(struct chan_data));
+
+	hash_insert(save->chan_pos, (uintptr_t) data,
+				UINT_TO_PTR(++save->count));
+}
+
+static void save_conn(uint64_t key, void *value, void *user_data)
+{
+	struct conn_data *conn = value;
+	struct save_data *save = user_data;
+
+	checkpoint_put(save->ckpt, &conn->index, sizeof(conn->index));
+	checkpoint_put(save->ckpt, &conn->handle, sizeof(conn->handle));
+
+	save_frag(save->ckpt, &conn->frag[0]);
+	save_frag(save->ckpt, &conn->frag[1]);
+
+	checkpoint_put_u32(save->ckpt, queue_length(conn->chan_list));
+	queue_foreach(conn->chan_list, save_chan, save);
+}
+
+static void save_chan_key(uint64_t key, void *value, void *user_data)
+{
+	struct save_data *save = user_data;
+	uint32_t pos;
+
+	pos = PTR_TO_UINT(hash_lookup(save->chan_pos, (uintptr_t) value));
+
+	checkpoint_put(save->ckpt, &key, sizeof(key));
+	checkpoint_put_u32(save->ckpt, pos);
+}
+
+void l2cap_save_state(struct checkpoint *ckpt)
+{
+	struct save_data save = { .ckpt = ckpt };
+
+	save.chan_pos = hash_new();
+	if (!save.chan_pos) {
+		ckpt->error = true;
 		return;
+	}
 
-	memset(&chan_list[n], 0, sizeof(chan_list[n]));
-	chan_list[n].index = frame->index;
-	chan_list[n].handle = frame->handle;
-	chan_list[n].ident = frame->ident;
+	checkpoint_put(ckpt, &chan_next, sizeof(chan_next));
 
-	if (frame->in)
-		chan_list[n].dcid = scid;
-	else
-		chan_list[n].scid = scid;
+	checkpoint_put_u32(ckpt, hash_count(conn_hash));
+	hash_foreach(conn_hash, save_conn, &save);
 
-	chan_list[n].psm = psm;
-	chan_list[n].ctrlid = ctrlid;
-	chan_list[n].mode = 0;
+	checkpoint_put_u32(ckpt, hash_count(chan_hash));
+	hash_foreach(chan_hash, save_chan_key, &save);
 
-	chan_list[n].seq_num = seq_num;
+	hash_destroy(save.chan_pos, NULL);
 }
 
-static void release_scid(const struct l2cap_frame *frame, uint16_t scid)
+static bool restore_conn(struct checkpoint *ckpt, struct chan_data ***chans,
+							uint32_t *num_chans)
 {
-	int i;
+	struct conn_data *conn;
+	struct chan_data *chan, **new_chans;
+	uint16_t index, handle;
+	uint32_t i, count;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	if (!checkpoint_get(ckpt, &index, sizeof(index)) ||
+			!checkpoint_get(ckpt, &handle, sizeof(handle)))
+		return false;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	conn = get_conn_data(index, handle, true);
+	if (!conn)
+		return false;
 
-		if (frame->in) {
-			if (chan_list[i].scid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
+	if (!restore_frag(ckpt, &conn->frag[0]) ||
+				!restore_frag(ckpt, &conn->frag[1]))
+		return false;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	if (!count)
+		return true;
+
+	new_chans = realloc(*chans, (*num_chans + count) * sizeof(*new_chans));
+	if (!new_chans)
+		return false;
+
+	*chans = new_chans;
+
+	for (i = 0; i < count; i++) {
+		chan = new0(struct chan_data, 1);
+		if (!chan)
+			return false;
+
+		if (!checkpoint_get(ckpt, chan, sizeof(*chan)) ||
+				!queue_push_tail(conn->chan_list, chan)) {
+			free(chan);
+			return false;
 		}
+
+		(*chans)[(*num_chans)++] = chan;
 	}
+
+	return true;
 }
 
-static void assign_dcid(const struct l2cap_frame *frame, uint16_t dcid,
-								uint16_t scid)
+bool l2cap_restore_state(struct checkpoint *ckpt)
 {
-	int i;
+	struct chan_data **chans = NULL;
+	uint32_t i, count, pos, num_chans = 0;
+	bool result = false;
+	uint64_t key;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	hash_destroy(conn_hash, conn_free);
+	hash_destroy(chan_hash, NULL);
+	conn_hash = NULL;
+	chan_hash = NULL;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	if (!checkpoint_get(ckpt, &chan_next, sizeof(chan_next)))
+		return false;
 
-		if (frame->ident != 0 && chan_list[i].ident != frame->ident)
-			continue;
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
 
-		if (frame->in) {
-			if (scid) {
-				if (chan_list[i].scid == scid) {
-					chan_list[i].dcid = dcid;
-					break;
-				}
-			} else {
-				if (chan_list[i].scid && !chan_list[i].dcid) {
-					chan_list[i].dcid = dcid;
-					break;
-				}
-			}
-		} else {
-			if (scid) {
-				if (chan_list[i].dcid == scid) {
-					chan_list[i].scid = dcid;
-					break;
-				}
-			} else {
-				if (chan_list[i].dcid && !chan_list[i].scid) {
-					chan_list[i].scid = dcid;
-					break;
-				}
-			}
-		}
+	conn_hash = hash_new();
+	chan_hash = hash_new();
+	if (!conn_hash || !chan_hash)
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (!restore_conn(ckpt, &chans, &num_chans))
+			goto done;
+	}
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		goto done;
+
+	for (i = 0; i < count; i++) {
+		if (!checkpoint_get(ckpt, &key, sizeof(key)) ||
+					!checkpoint_get_u32(ckpt, &pos))
+			goto done;
+
+		if (!pos || pos > num_chans)
+			goto done;
+
+		if (!hash_insert(chan_hash, key, chans[pos - 1]))
+			goto done;
 	}
+
+	result = true;
+
+done:
+	free(chans);
+
+	return result;
 }
 
-static void assign_mode(const struct l2cap_frame *frame,
-					uint8_t mode, uint16_t dcid)
+struct match_cid {
+	bool in;
+	uint16_t cid;
+};
+
+static bool match_chan_cid(const void *data, const void *match_data)
 {
-	int i;
+	const struct chan_data *chan = data;
+	const struct match_cid *match = match_data;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	if (match->in)
+		return chan->scid == match->cid;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	return chan->dcid == match->cid;
+}
 
-		if (frame->in) {
-			if (chan_list[i].scid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		}
+static struct chan_data *find_chan(const struct l2cap_frame *frame,
+								uint16_t cid)
+{
+	struct match_cid match = { frame->in, cid };
+	struct conn_data *conn;
+
+	conn = get_conn_data(frame->index, frame->handle, false);
+	if (!conn)
+		return NULL;
+
+	return queue_find(conn->chan_list, match_chan_cid, &match);
+}
+
+struct assign_scid_data {
+	uint16_t scid;
+	uint16_t psm;
+	bool in;
+	uint8_t seq_num;
+	struct chan_data *chan;
+};
+
+static void assign_scid_lookup(void *data, void *user_data)
+{
+	struct chan_data *chan = data;
+	struct assign_scid_data *assign = user_data;
+
+	if (chan->psm == assign->psm)
+		assign->seq_num++;
+
+	/* Don't stop on match - we still need to go through all
+	 * channels to find proper seq_num.
+	 */
+	if (assign->in) {
+		if (chan->dcid == assign->scid)
+			assign->chan = chan;
+	} else {
+		if (chan->scid == assign->scid)
+			assign->chan = chan;
 	}
 }
 
-static int get_chan_data_index(const struct l2cap_frame *frame)
+static void assign_scid(const struct l2cap_frame *frame,
+				uint16_t scid, uint16_t psm, uint8_t ctrlid)
 {
-	int i;
+	struct assign_scid_data assign = { scid, psm, frame->in, 1, NULL };
+	struct conn_data *conn;
+	struct chan_data *chan;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index &&
-					chan_list[i].ctrlid == 0)
-			continue;
+	conn = get_conn_data(frame->index, frame->handle, true);
+	if (!conn)
+		return;
 
-		if (chan_list[i].ctrlid != 0 &&
-					chan_list[i].ctrlid != frame->index)
-			continue;
+	queue_foreach(conn->chan_list, assign_scid_lookup, &assign);
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	chan = assign.chan;
+	if (chan)
+		chan_hash_del(chan);
+	else {
+		chan = new0(struct chan_data, 1);
+		if (!chan)
+			return;
 
-		if (frame->in) {
-			if (chan_list[i].scid == frame->cid)
-				return i;
-		} else {
-			if (chan_list[i].dcid == frame->cid)
-				return i;
+		if (!queue_push_tail(conn->chan_list, chan)) {
+			free(chan);
+			return;
 		}
 	}
 
-	return -1;
+	memset(chan, 0, sizeof(*chan));
+	chan->index = frame->index;
+	chan->handle = frame->handle;
+	chan->ident = frame->ident;
+
+	if (frame->in)
+		chan->dcid = scid;
+	else
+		chan->scid = scid;
+
+	chan->psm = psm;
+	chan->ctrlid = ctrlid;
+	chan->mode = 0;
+
+	chan->seq_num = assign.seq_num;
+
+	/* Zero means no channel, so skip it when the counter wraps */
+	if (!++chan_next)
+		chan_next++;
+	chan->chan = chan_next;
+
+	chan_hash_add(chan);
 }
 
-static uint16_t get_psm(const struct l2cap_frame *frame)
+static void release_scid(const struct l2cap_frame *frame, uint16_t scid)
 {
-	int i = get_chan_data_index(frame);
+	struct match_cid match = { frame->in, scid };
+	struct conn_data *conn;
+	struct chan_data *chan;
 
-	if (i < 0)
-		return 0;
+	conn = get_conn_data(frame->index, frame->handle, false);
+	if (!conn)
+		return;
 
-	return chan_list[i].psm;
+	chan = queue_remove_if(conn->chan_list, match_chan_cid, &match);
+	if (chan)
+		chan_free(chan);
 }
 
-static uint8_t get_mode(const struct l2cap_frame *frame)
+struct assign_dcid_data {
+	const struct l2cap_frame *frame;
+	uint16_t scid;
+};
+
+static bool match_assign_dcid(const void *data, const void *match_data)
 {
-	int i = get_chan_data_index(frame);
+	const struct chan_data *chan = data;
+	const struct assign_dcid_data *assign = match_data;
+	const struct l2cap_frame *frame = assign->frame;
 
-	if (i < 0)
-		return 0;
+	if (frame->ident != 0 && chan->ident != frame->ident)
+		return false;
+
+	if (frame->in) {
+		if (assign->scid)
+			return chan->scid == assign->scid;
+
+		return chan->scid && !chan->dcid;
+	}
 
-	return chan_list[i].mode;
+	if (assign->scid)
+		return chan->dcid == assign->scid;
+
+	return chan->dcid && !chan->scid;
 }
 
-static uint16_t get_chan(const struct l2cap_frame *frame)
+static void assign_dcid(const struct l2cap_frame *frame, uint16_t dcid,
+								uint16_t scid)
 {
-	int i = get_chan_data_index(frame);
+	struct assign_dcid_data assign = { frame, scid };
+	struct conn_data *conn;
+	struct chan_data *chan;
 
-	if (i < 0)
-		return 0;
+	conn = get_conn_data(frame->index, frame->handle, false);
+	if (!conn)
+		return;
+
+	chan = queue_find(conn->chan_list, match_assign_dcid, &assign);
+	if (!chan)
+		return;
 
-	return i;
+	chan_hash_del(chan);
+
+	if (frame->in)
+		chan->dcid = dcid;
+	else
+		chan->scid = dcid;
+
+	chan_hash_add(chan);
 }
 
-static uint8_t get_seq_num(const struct l2cap_frame *frame)
+static void assign_mode(const struct l2cap_frame *frame,
+					uint8_t mode, uint16_t dcid)
 {
-	int i = get_chan_data_index(frame);
+	struct chan_data *chan = find_chan(frame, dcid);
 
-	if (i < 0)
-		return 0;
+	if (chan)
+		chan->mode = mode;
+}
 
-	return chan_list[i].seq_num;
+static struct chan_data *get_chan_data(const struct l2cap_frame *frame)
+{
+	return hash_lookup(chan_hash, chan_key(frame->index, frame->handle,
+							frame->in, frame->cid));
 }
 
 static void assign_ext_ctrl(const struct l2cap_frame *frame,
 					uint8_t ext_ctrl, uint16_t dcid)
 {
-	int i;
+	struct chan_data *chan = find_chan(frame, dcid);
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
-
-		if (chan_list[i].handle != frame->handle)
-			continue;
-
-		if (frame->in) {
-			if (chan_list[i].scid == dcid) {
-				chan_list[i].ext_ctrl = ext_ctrl;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == dcid) {
-				chan_list[i].ext_ctrl = ext_ctrl;
-				break;
-			}
-		}
-	}
+	if (chan)
+		chan->ext_ctrl = ext_ctrl;
 }
 
 static uint8_t get_ext_ctrl(const struct l2cap_frame *frame)
 {
-	int i = get_chan_data_index(frame);
+	struct chan_data *chan = get_chan_data(frame);
 
-	if (i < 0)
+	if (!chan)
 		return 0;
 
-	return chan_list[i].ext_ctrl;
+	return chan->ext_ctrl;
 }
 
 static char *sar2str(uint8_t sar)
@@ -459,25 +739,6 @@ static void l2cap_ctrl_parse(struct l2cap_frame *frame, uint32_t ctrl)
 		printf(" F-bit");
 }
 
-#define MAX_INDEX 16
-
-struct index_data {
-	void *frag_buf;
-	uint16_t frag_pos;
-	uint16_t frag_len;
-	uint16_t frag_cid;
-};
-
-static struct index_data index_list[MAX_INDEX][2];
-
-static void clear_fragment_buffer(uint16_t index, bool in)
-{
-	free(index_list[index][in].frag_buf);
-	index_list[index][in].frag_buf = NULL;
-	index_list[index][in].frag_pos = 0;
-	index_list[index][in].frag_len = 0;
-}
-
 static void print_psm(uint16_t psm)
 {
 	print_field("PSM: %d (0x%4.4x)", le16_to_cpu(psm), le16_to_cpu(psm));
@@ -1403,6 +1664,8 @@ static void l2cap_frame_init(struct l2cap_frame *frame, uint16_t index, bool in,
 				uint16_t handle, uint8_t ident,
 				uint16_t cid, const void *data, uint16_t size)
 {
+	struct chan_data *chan;
+
 	frame->index   = index;
 	frame->in      = in;
 	frame->handle  = handle;
@@ -1410,10 +1673,20 @@ static void l2cap_frame_init(struct l2cap_frame *frame, uint16_t index, bool in,
 	frame->cid     = cid;
 	frame->data    = data;
 	frame->size    = size;
-	frame->psm     = get_psm(frame);
-	frame->mode    = get_mode(frame);
-	frame->chan    = get_chan(frame);
-	frame->seq_num = get_seq_num(frame);
+
+	chan = get_chan_data(frame);
+	if (!chan) {
+		frame->psm     = 0;
+		frame->mode    = 0;
+		frame->chan    = 0;
+		frame->seq_num = 0;
+		return;
+	}
+
+	frame->psm     = chan->psm;
+	frame->mode    = chan->mode;
+	frame->chan    = chan->chan;
+	frame->seq_num = chan->seq_num;
 }
 
 static void bredr_sig_packet(uint16_t index, bool in, uint16_t handle,
@@ -1988,6 +2261,9 @@ static void print_hex_field(const char *label, const uint8_t *data,
 	char str[len * 2 + 1];
 	uint8_t i;
 
+	if (packet_has_filter(PACKET_FILTER_NO_OUTPUT))
+		return;
+
 	str[0] = '\0';
 
 	for (i = 0; i < len; i++)
@@ -2517,6 +2793,9 @@ static void att_packet(uint16_t index, bool in, uint16_t handle,
 		return;
 	}
 
+	att_track(index, in, handle, data, size);
+	stats_att(opcode);
+
 	for (i = 0; att_opcode_table[i].str; i++) {
 		if (att_opcode_table[i].opcode == opcode) {
 			opcode_data = &att_opcode_table[i];
@@ -3023,6 +3302,9 @@ static void l2cap_frame(uint16_t index, bool in, uint16_t handle,
 	uint16_t ctrl16 = 0;
 	uint8_t ext_ctrl;
 
+	if (cid < 0x0040)
+		stats_l2cap(cid, 0);
+
 	switch (cid) {
 	case 0x0001:
 		bredr_sig_packet(index, in, handle, cid, data, size);
@@ -3046,6 +3328,8 @@ static void l2cap_frame(uint16_t index, bool in, uint16_t handle,
 	default:
 		l2cap_frame_init(&frame, index, in, handle, 0, cid, data, size);
 
+		stats_l2cap(cid, frame.psm);
+
 		if (frame.mode > 0) {
 			ext_ctrl = get_ext_ctrl(&frame);
 
@@ -3115,21 +3399,28 @@ void l2cap_packet(uint16_t index, bool in, uint16_t handle, uint8_t flags,
 					const void *data, uint16_t size)
 {
 	const struct bt_l2cap_hdr *hdr = data;
+	struct conn_data *conn;
+	struct frag_data *frag;
 	uint16_t len, cid;
 
-	if (index > MAX_INDEX - 1) {
-		print_text(COLOR_ERROR, "controller index too large");
+	packet_conn_account(index, handle, in, size);
+
+	conn = get_conn_data(index, handle, true);
+	if (!conn) {
+		print_text(COLOR_ERROR, "failed connection allocation");
 		packet_hexdump(data, size);
 		return;
 	}
 
+	frag = &conn->frag[in];
+
 	switch (flags) {
 	case 0x00:	/* start of a non-automatically-flushable PDU */
 	case 0x02:	/* start of an automatically-flushable PDU */
-		if (index_list[index][in].frag_len) {
+		if (frag->len) {
 			print_text(COLOR_ERROR, "unexpected start frame");
 			packet_hexdump(data, size);
-			clear_fragment_buffer(index, in);
+			frag_clear(frag);
 			return;
 		}
 
@@ -3157,54 +3448,43 @@ void l2cap_packet(uint16_t index, bool in, uint16_t handle, uint8_t flags,
 			return;
 		}
 
-		index_list[index][in].frag_buf = malloc(len);
-		if (!index_list[index][in].frag_buf) {
+		if (!frag_start(frag, cid, len)) {
 			print_text(COLOR_ERROR, "failed buffer allocation");
 			packet_hexdump(data, size);
 			return;
 		}
 
-		memcpy(index_list[index][in].frag_buf, data, size);
-		index_list[index][in].frag_pos = size;
-		index_list[index][in].frag_len = len - size;
-		index_list[index][in].frag_cid = cid;
+		frag_append(frag, data, size);
 		break;
 
 	case 0x01:	/* continuing fragment */
-		if (!index_list[index][in].frag_len) {
+		if (!frag->len) {
 			print_text(COLOR_ERROR, "unexpected continuation");
 			packet_hexdump(data, size);
 			return;
 		}
 
-		if (size > index_list[index][in].frag_len) {
+		if (!frag_append(frag, data, size)) {
 			print_text(COLOR_ERROR, "fragment too long");
 			packet_hexdump(data, size);
-			clear_fragment_buffer(index, in);
+			frag_clear(frag);
 			return;
 		}
 
-		memcpy(index_list[index][in].frag_buf +
-				index_list[index][in].frag_pos, data, size);
-		index_list[index][in].frag_pos += size;
-		index_list[index][in].frag_len -= size;
-
-		if (!index_list[index][in].frag_len) {
+		if (!frag->len) {
 			/* complete frame */
-			l2cap_frame(index, in, handle,
-					index_list[index][in].frag_cid,
-					index_list[index][in].frag_buf,
-					index_list[index][in].frag_pos);
-			clear_fragment_buffer(index, in);
+			l2cap_frame(index, in, handle, frag->cid,
+						frag->buf, frag->pos);
+			frag_clear(frag);
 			return;
 		}
 		break;
 
 	case 0x03:	/* complete automatically-flushable PDU */
-		if (index_list[index][in].frag_len) {
+		if (frag->len) {
 			print_text(COLOR_ERROR, "unexpected complete frame");
 			packet_hexdump(data, size);
-			clear_fragment_buffer(index, in);
+			frag_clear(frag);
 			return;
 		}
 
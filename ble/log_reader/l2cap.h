@@ -172,5 +172,11 @@ static inline bool l2cap_frame_get_be128(struct l2cap_frame *frame,
 
 void l2cap_packet(uint16_t index, bool in, uint16_t handle, uint8_t flags,
 					const void *data, uint16_t size);
+void l2cap_release_conn(uint16_t index, uint16_t handle);
+
+struct checkpoint;
+
+void l2cap_save_state(struct checkpoint *ckpt);
+bool l2cap_restore_state(struct checkpoint *ckpt);
 
 void rfcomm_packet(const struct l2cap_frame *frame);
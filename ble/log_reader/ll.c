@@ -27,51 +27,244 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <sys/time.h>
 
 #include "src/shared/util.h"
 #include "display.h"
 #include "packet.h"
 #include "crc.h"
+#include "crc24.h"
+#include "hash.h"
 #include "bt.h"
+#include "checkpoint.h"
 #include "ll.h"
 
 #define COLOR_OPCODE		COLOR_MAGENTA
 #define COLOR_OPCODE_UNKNOWN	COLOR_WHITE_BG
 
-#define MAX_CHANNEL 16
+#define ADV_ACCESS_ADDR		0x8e89bed6
+#define ADV_CRC_INIT		0xaaaaaa
 
+/*
+ * Jitter histogram buckets are powers of two in microseconds, the last
+ * bucket collects everything from 2^(LL_HIST_BUCKETS - 1) us upwards.
+ */
+#define LL_HIST_BUCKETS		16
+#define LL_DATA_CHANNELS	37
+
+/*
+ * Connection timing is derived from the first packet seen in each
+ * connection event, which is taken as its anchor point. A new event
+ * starts when the RF channel changes or more than half an interval has
+ * passed since the previous packet. Parameter and channel map updates
+ * are applied once the event counter reaches their instant.
+ */
+struct conn_timing {
+	uint16_t interval;
+	uint8_t map[5];
+	bool update_pending;
+	uint16_t update_instant;
+	uint16_t update_interval;
+	bool map_pending;
+	uint16_t map_instant;
+	uint8_t update_map[5];
+	bool anchored;
+	uint16_t counter;
+	uint8_t last_channel;
+	struct timeval anchor;
+	struct timeval last;
+	unsigned long events;
+	unsigned long missed;
+	unsigned long resyncs;
+	unsigned long out_of_map;
+	unsigned long jitter_count;
+	uint64_t jitter_total;
+	uint64_t jitter_max;
+	unsigned long jitter_hist[LL_HIST_BUCKETS];
+	unsigned long channel_events[LL_DATA_CHANNELS];
+};
+
+/*
+ * Channels are keyed by access address. The CRC init is stored already
+ * bit reversed so that it can be used directly as the preset of
+ * crc24_table_calculate().
+ */
 struct channel_data {
 	uint32_t access_addr;
 	uint32_t crc_init;
+	unsigned long packets;
+	unsigned long crc_errors;
+	struct conn_timing timing;
 };
 
-static struct channel_data channel_list[MAX_CHANNEL];
+static struct hash *channel_hash = NULL;
+static unsigned long unknown_packets;
 
-static void set_crc_init(uint32_t access_addr, uint32_t crc_init)
+/* Channel of the data channel PDU currently being decoded */
+static struct channel_data *current_chan = NULL;
+
+static struct channel_data *get_channel(uint32_t access_addr, bool create)
 {
-	int i;
+	struct channel_data *chan;
 
-	for (i = 0; i < MAX_CHANNEL; i++) {
-		if (channel_list[i].access_addr == 0x00000000 ||
-				channel_list[i].access_addr == access_addr) {
-			channel_list[i].access_addr = access_addr;
-			channel_list[i].crc_init = crc_init;
-			break;
-		}
+	if (!channel_hash) {
+		if (!create)
+			return NULL;
+
+		channel_hash = hash_new();
+		if (!channel_hash)
+			return NULL;
 	}
+
+	chan = hash_lookup(channel_hash, access_addr);
+	if (chan || !create)
+		return chan;
+
+	chan = new0(struct channel_data, 1);
+	if (!chan)
+		return NULL;
+
+	chan->access_addr = access_addr;
+
+	if (!hash_insert(channel_hash, access_addr, chan)) {
+		free(chan);
+		return NULL;
+	}
+
+	return chan;
 }
 
-static uint32_t get_crc_init(uint32_t access_addr)
+static void set_crc_init(uint32_t access_addr, uint32_t crc_init)
 {
-	int i;
+	struct channel_data *chan;
+
+	chan = get_channel(access_addr, true);
+	if (chan)
+		chan->crc_init = crc_init;
+}
+
+static void set_conn_params(uint32_t access_addr, uint16_t interval,
+							const uint8_t *map)
+{
+	struct channel_data *chan;
+
+	chan = get_channel(access_addr, true);
+	if (!chan)
+		return;
+
+	memset(&chan->timing, 0, sizeof(chan->timing));
+	chan->timing.interval = interval;
+	memcpy(chan->timing.map, map, sizeof(chan->timing.map));
+}
+
+/* Map an RF channel to its data channel index, or -1 for advertising */
+static int rf_to_data_channel(uint8_t rf_channel)
+{
+	if (rf_channel == 0 || rf_channel == 12 || rf_channel >= 39)
+		return -1;
 
-	for (i = 0; i < MAX_CHANNEL; i++) {
-		if (channel_list[i].access_addr == access_addr)
-			return channel_list[i].crc_init;
+	if (rf_channel < 12)
+		return rf_channel - 1;
+
+	return rf_channel - 2;
+}
+
+static void add_jitter(struct conn_timing *timing, uint64_t usec)
+{
+	unsigned int bucket = 0;
+
+	if (usec > timing->jitter_max)
+		timing->jitter_max = usec;
+
+	timing->jitter_count++;
+	timing->jitter_total += usec;
+
+	while (bucket < LL_HIST_BUCKETS - 1 && (usec >> (bucket + 1)))
+		bucket++;
+
+	timing->jitter_hist[bucket]++;
+}
+
+static bool instant_passed(uint16_t counter, uint16_t instant)
+{
+	return (int16_t) (counter - instant) >= 0;
+}
+
+static void track_event(struct conn_timing *timing, uint8_t rf_channel,
+						const struct timeval *tv)
+{
+	uint64_t interval_us, delta, expected, events;
+	bool resync = false;
+	int channel;
+
+	if (!timing->interval)
+		return;
+
+	channel = rf_to_data_channel(rf_channel);
+	if (channel < 0)
+		return;
+
+	interval_us = timing->interval * 1250ULL;
+
+	if (timing->anchored) {
+		/* Further packets of the current connection event */
+		if (channel == timing->last_channel &&
+				packet_elapsed_usec(&timing->last, tv) <
+							interval_us / 2) {
+			timing->last = *tv;
+			return;
+		}
+
+		delta = packet_elapsed_usec(&timing->anchor, tv);
+
+		events = (delta + interval_us / 2) / interval_us;
+		if (!events)
+			events = 1;
+
+		timing->counter += events;
+
+		if (timing->update_pending &&
+				instant_passed(timing->counter,
+						timing->update_instant)) {
+			/* The transmit window makes this anchor unpredictable */
+			timing->interval = timing->update_interval;
+			timing->update_pending = false;
+			timing->counter = timing->update_instant;
+			timing->resyncs++;
+			resync = true;
+		}
+
+		if (timing->map_pending &&
+				instant_passed(timing->counter,
+						timing->map_instant)) {
+			memcpy(timing->map, timing->update_map,
+						sizeof(timing->map));
+			timing->map_pending = false;
+		}
+
+		if (!resync) {
+			expected = events * interval_us;
+
+			timing->missed += events - 1;
+			add_jitter(timing, delta > expected ?
+						delta - expected :
+						expected - delta);
+		}
 	}
 
-	return 0x00000000;
+	timing->anchored = true;
+	timing->anchor = *tv;
+	timing->last = *tv;
+	timing->last_channel = channel;
+
+	timing->events++;
+	timing->channel_events[channel]++;
+
+	if (!(timing->map[channel / 8] & (1 << (channel % 8))))
+		timing->out_of_map++;
 }
 
 static void advertising_packet(const void *data, uint8_t size)
@@ -202,6 +395,8 @@ static void advertising_packet(const void *data, uint8_t size)
 
 		packet_print_channel_map_ll(ptr + 30);
 
+		set_conn_params(access_addr, interval, ptr + 30);
+
 		hop = ptr[35] & 0x1f;
 		sca = (ptr[35] & 0xe0) >> 5;
 
@@ -309,6 +504,7 @@ void ll_packet(uint16_t frequency, const void *data, uint8_t size, bool padded)
 	const uint8_t *pdu_data;
 	uint8_t pdu_len;
 	uint32_t pdu_crc, crc, crc_init;
+	struct channel_data *chan;
 
 	if (size < sizeof(*hdr)) {
 		print_text(COLOR_ERROR, "packet missing header");
@@ -336,7 +532,7 @@ void ll_packet(uint16_t frequency, const void *data, uint8_t size, bool padded)
 	pdu_crc = pdu_data[pdu_len + 0] | (pdu_data[pdu_len + 1] << 8) |
 						(pdu_data[pdu_len + 2] << 16);
 
-	if (access_addr == 0x8e89bed6) {
+	if (access_addr == ADV_ACCESS_ADDR) {
 		channel_label = "Advertising channel: ";
 		channel_color = COLOR_MAGENTA;
 	} else {
@@ -349,26 +545,45 @@ void ll_packet(uint16_t frequency, const void *data, uint8_t size, bool padded)
 	print_indent(6, channel_color, channel_label, access_str, COLOR_OFF,
 		" (channel %d) len %d crc 0x%6.6x", channel, pdu_len, pdu_crc);
 
-	if (access_addr == 0x8e89bed6)
-		crc_init = 0xaaaaaa;
-	else
-		crc_init = get_crc_init(access_addr);
+	if (access_addr == ADV_ACCESS_ADDR) {
+		chan = get_channel(access_addr, true);
+		crc_init = ADV_CRC_INIT;
+	} else {
+		chan = get_channel(access_addr, false);
+		crc_init = chan ? chan->crc_init : 0x00000000;
+
+		/* Corrupted packets still mark a connection event */
+		if (chan)
+			track_event(&chan->timing, channel, packet_get_time());
+	}
 
 	if (crc_init) {
-		crc = crc24_calculate(crc_init, pdu_data, pdu_len);
+		crc = crc24_table_calculate(crc_init, pdu_data, pdu_len);
+
+		if (chan)
+			chan->packets++;
 
 		if (crc != pdu_crc) {
+			if (chan)
+				chan->crc_errors++;
+
 			print_text(COLOR_ERROR, "invalid checksum");
 			packet_hexdump(pdu_data, pdu_len);
 			return;
 		}
-	} else
+	} else {
+		unknown_packets++;
 		print_text(COLOR_ERROR, "unknown access address");
+	}
 
-	if (access_addr == 0x8e89bed6)
+	if (access_addr == ADV_ACCESS_ADDR) {
 		advertising_packet(pdu_data, pdu_len);
-	else
-		data_packet(pdu_data, pdu_len, padded);
+		return;
+	}
+
+	current_chan = chan;
+	data_packet(pdu_data, pdu_len, padded);
+	current_chan = NULL;
 }
 
 static void null_pdu(const void *data, uint8_t size)
@@ -385,6 +600,14 @@ static void conn_update_req(const void *data, uint8_t size)
 	print_field("Connection slave latency: %u", le16_to_cpu(pdu->latency));
 	print_field("Connection supervision timeout: %u", le16_to_cpu(pdu->timeout));
 	print_field("Connection instant: %u", le16_to_cpu(pdu->instant));
+
+	if (current_chan) {
+		struct conn_timing *timing = &current_chan->timing;
+
+		timing->update_pending = true;
+		timing->update_instant = le16_to_cpu(pdu->instant);
+		timing->update_interval = le16_to_cpu(pdu->interval);
+	}
 }
 
 static void channel_map_req(const void *data, uint8_t size)
@@ -393,6 +616,14 @@ static void channel_map_req(const void *data, uint8_t size)
 
 	packet_print_channel_map_ll(pdu->map);
 	print_field("Connection instant: %u", le16_to_cpu(pdu->instant));
+
+	if (current_chan) {
+		struct conn_timing *timing = &current_chan->timing;
+
+		timing->map_pending = true;
+		timing->map_instant = le16_to_cpu(pdu->instant);
+		memcpy(timing->update_map, pdu->map, sizeof(timing->update_map));
+	}
 }
 
 static void terminate_ind(const void *data, uint8_t size)
@@ -570,3 +801,129 @@ void llcp_packet(const void *data, uint8_t size, bool padded)
 
 	llcp_data->func(data + 1, size - 1);
 }
+
+static void print_timing(const struct conn_timing *timing)
+{
+	unsigned int i, used = 0;
+
+	if (!timing->events)
+		return;
+
+	printf("    Connection interval: %u (%.2f ms)\n", timing->interval,
+						timing->interval * 1.25);
+	printf("    Connection events: %lu seen, %lu missed",
+					timing->events, timing->missed);
+
+	if (timing->resyncs)
+		printf(", %lu parameter updates", timing->resyncs);
+
+	printf("\n");
+
+	if (timing->jitter_count) {
+		printf("    Anchor jitter: avg %" PRIu64 " us max %" PRIu64
+				" us\n", timing->jitter_total /
+				timing->jitter_count, timing->jitter_max);
+
+		for (i = 0; i < LL_HIST_BUCKETS; i++) {
+			if (!timing->jitter_hist[i])
+				continue;
+
+			if (i == LL_HIST_BUCKETS - 1)
+				printf("      >= %8lu us: %lu\n", 1UL << i,
+							timing->jitter_hist[i]);
+			else
+				printf("      %8lu - %8lu us: %lu\n",
+						i ? 1UL << i : 0UL,
+						(1UL << (i + 1)) - 1,
+						timing->jitter_hist[i]);
+		}
+	}
+
+	for (i = 0; i < LL_DATA_CHANNELS; i++) {
+		if (timing->channel_events[i])
+			used++;
+	}
+
+	printf("    Data channels used: %u", used);
+
+	if (timing->out_of_map)
+		printf(", %lu events outside channel map",
+						timing->out_of_map);
+
+	printf("\n");
+
+	for (i = 0; i < LL_DATA_CHANNELS; i++) {
+		if (timing->channel_events[i])
+			printf("      Channel %2u: %lu\n", i,
+						timing->channel_events[i]);
+	}
+}
+
+static void print_channel(uint64_t key, void *value, void *user_data)
+{
+	struct channel_data *chan = value;
+
+	if (!chan->packets)
+		return;
+
+	printf("  Access address 0x%8.8x: %lu packets, %lu CRC errors "
+				"(%.2f%%)\n", chan->access_addr, chan->packets,
+				chan->crc_errors,
+				100.0 * chan->crc_errors / chan->packets);
+
+	print_timing(&chan->timing);
+}
+
+void ll_print_summary(void)
+{
+	if (!hash_count(channel_hash) && !unknown_packets)
+		return;
+
+	printf("\nLL summary\n");
+
+	hash_foreach(channel_hash, print_channel, NULL);
+
+	if (unknown_packets)
+		printf("  Unknown access address: %lu packets\n",
+							unknown_packets);
+
+	hash_destroy(channel_hash, free);
+	channel_hash = NULL;
+	unknown_packets = 0;
+}
+
+static void save_channel(uint64_t key, void *value, void *user_data)
+{
+	checkpoint_put(user_data, value, sizeof(struct channel_data));
+}
+
+void ll_save_state(struct checkpoint *ckpt)
+{
+	checkpoint_put_u32(ckpt, hash_count(channel_hash));
+	hash_foreach(channel_hash, save_channel, ckpt);
+}
+
+bool ll_restore_state(struct checkpoint *ckpt)
+{
+	struct channel_data *chan, data;
+	uint32_t i, count;
+
+	hash_destroy(channel_hash, free);
+	channel_hash = NULL;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (!checkpoint_get(ckpt, &data, sizeof(data)))
+			return false;
+
+		chan = get_channel(data.access_addr, true);
+		if (!chan)
+			return false;
+
+		*chan = data;
+	}
+
+	return true;
+}
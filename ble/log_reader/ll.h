@@ -26,3 +26,9 @@
 
 void ll_packet(uint16_t frequency, const void *data, uint8_t size, bool padded);
 void llcp_packet(const void *data, uint8_t size, bool padded);
+void ll_print_summary(void);
+
+struct checkpoint;
+
+void ll_save_state(struct checkpoint *ckpt);
+bool ll_restore_state(struct checkpoint *ckpt);
@@ -13,7 +13,7 @@ t_packet *read_next_packet(int fd) {
 	uint64_t timestamp;
 	uint16_t len;
 	uint8_t type;
-	uint8_t *data;
+	uint8_t *buf, *data;
 
 	le_advertising_info **infos;
 	uint8_t nb_info;
@@ -27,6 +27,11 @@ t_packet *read_next_packet(int fd) {
 		printf("Cannot read length\n");
 		return NULL;
 	}
+
+	if (len < 2) {
+		printf("Packet too short\n");
+		return NULL;
+	}
 	
 	if (read(fd, &type, 1) != 1) {
 		printf("Cannot read type\n");
@@ -36,36 +41,61 @@ t_packet *read_next_packet(int fd) {
 
 	if (read(fd, &nb_info, 1) != 1) {
 		printf("Cannot read nb adv info\n");
-		len--;
+		return NULL;
+	}
+	len--;
+
+	buf = data = malloc(len);
+	if (!buf && len) {
+		printf("Cannot allocate data\n");
+		return NULL;
 	}
 
-	data = malloc(len);
 	if (read(fd, data, len) != len) {
 		printf("Cannot read data\n");
+		free(buf);
 		return NULL;
 	}
 
 	infos = malloc(nb_info * sizeof(le_advertising_info *));
+	packet = malloc(sizeof(t_packet));
+	if ((!infos && nb_info) || !packet) {
+		printf("Cannot allocate packet\n");
+		free(infos);
+		free(packet);
+		free(buf);
+		return NULL;
+	}
 
+	/*
+	 * Keep only the reports that fit, their AD data is read in place.
+	 * Each report is followed by its RSSI octet.
+	 */
 	int i = 0;
 	while (i < nb_info) {
+		if (len < sizeof(le_advertising_info) + 1)
+			break;
+
 		infos[i] = (le_advertising_info *) data;
-		data += sizeof(le_advertising_info) + infos[i]->length;
-		len -= sizeof(le_advertising_info) + infos[i]->length;
+		if (len < sizeof(le_advertising_info) + infos[i]->length + 1)
+			break;
+
+		data += sizeof(le_advertising_info) + infos[i]->length + 1;
+		len -= sizeof(le_advertising_info) + infos[i]->length + 1;
 		i++;
 	}
-
-	packet = malloc(sizeof(t_packet));
+	nb_info = i;
 
 	packet->timestamp = timestamp;
 	packet->nb_info = nb_info;
+	packet->data = buf;
 	packet->infos = infos;
 	return packet;
 }
 
 void packet_free(t_packet *p) {
 
-	free(p->infos[0]);
+	free(p->data);
 
 	free(p->infos);
 	free(p);
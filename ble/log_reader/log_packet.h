@@ -5,10 +5,12 @@
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 
+/* The RSSI of a report is the octet after its AD data */
 typedef struct {
 	uint64_t timestamp;
 	uint8_t nb_info;
 	le_advertising_info **infos;
+	uint8_t *data;
 } t_packet;
 
 t_packet *read_next_packet(int fd);
@@ -1,25 +1,88 @@
 #include "log_packet.h"
+#include "ad.h"
+#include "record.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 
 void usage() {
-	printf("./log_reader log_file\n");
+	printf("./log_reader [-n] [-f name] [-b file] log_file\n");
+	printf("\t-n\t\tshow the advertised name after the address\n");
+	printf("\t-f name\t\tonly show devices advertising this name\n");
+	printf("\t-b file\t\twrite the shown reports as records to file\n");
 	exit(1);
 }
 
+static bool get_name(le_advertising_info *info, const char **name,
+							uint8_t *name_len) {
+	struct ad_field field;
+
+	if (!ad_find(info->data, info->length, AD_TYPE_NAME_COMPLETE, &field) &&
+			!ad_find(info->data, info->length, AD_TYPE_NAME_SHORT,
+								&field))
+		return false;
+
+	return ad_get_name(&field, name, name_len);
+}
+
+static void record_info(uint64_t timestamp, le_advertising_info *info) {
+	struct timeval tv = { .tv_sec = timestamp };
+	struct ad_iter iter;
+	struct ad_field field;
+
+	record_report_begin(&tv);
+	record_u8(RECORD_EVENT_TYPE, info->evt_type);
+	record_u8(RECORD_ADDRESS_TYPE, info->bdaddr_type);
+	record_data(RECORD_ADDRESS, &info->bdaddr, 6);
+
+	ad_iter_init(&iter, info->data, info->length);
+	while (ad_iter_next(&iter, &field))
+		record_ad(&field);
+
+	record_u8(RECORD_RSSI, info->data[info->length]);
+	record_report_end();
+}
+
 int main( int argc, char **argv ) {
 
-	if (argc != 2)
+	const char *filter = NULL;
+	const char *record_path = NULL;
+	bool show_name = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "nf:b:")) != -1) {
+		switch (opt) {
+		case 'n':
+			show_name = true;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'b':
+			record_path = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (argc - optind != 1)
 		usage();
 
-	int fd = open(argv[1], O_RDONLY);
+	int fd = open(argv[optind], O_RDONLY);
 
 	if (!fd) {
-		printf("Cannot open %s\n", argv[1]);
+		printf("Cannot open %s\n", argv[optind]);
+		return 1;
+	}
+
+	if (record_path && !record_open(record_path)) {
+		close(fd);
 		return 1;
 	}
 
@@ -28,10 +91,28 @@ int main( int argc, char **argv ) {
 
 		int i;
 		for (i = 0; i < p->nb_info; i++) {
+			le_advertising_info *info = p->infos[i];
+			const char *name = NULL;
+			uint8_t name_len = 0;
 			char addr[18];
-			ba2str(&p->infos[0]->bdaddr, addr);
 
-			printf("%s\n", addr);
+			if ((show_name || filter) &&
+					!get_name(info, &name, &name_len))
+				name = NULL;
+
+			if (filter && (!name || name_len != strlen(filter) ||
+					strncmp(name, filter, name_len)))
+				continue;
+
+			if (record_path)
+				record_info(p->timestamp, info);
+
+			ba2str(&info->bdaddr, addr);
+
+			if (show_name && name)
+				printf("%s %.*s\n", addr, name_len, name);
+			else
+				printf("%s\n", addr);
 		}
 
 		packet_free(p);
@@ -39,6 +120,8 @@ int main( int argc, char **argv ) {
 		p = read_next_packet(fd);
 	} 
 
+	record_close();
+
 	close(fd);
 	return 0;
 }
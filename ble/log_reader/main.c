@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
@@ -39,7 +41,13 @@
 #include "lmp.h"
 #include "keys.h"
 #include "analyze.h"
+#include "stats.h"
+#include "pktindex.h"
+#include "fanout.h"
 #include "ellisys.h"
+#include "output.h"
+#include "record.h"
+#include "render.h"
 #include "control.h"
 
 static void signal_callback(int signum, void *user_data)
@@ -47,6 +55,7 @@ static void signal_callback(int signum, void *user_data)
 	switch (signum) {
 	case SIGINT:
 	case SIGTERM:
+		control_flush();
 		mainloop_quit();
 		break;
 	}
@@ -60,8 +69,24 @@ static void usage(void)
 	printf("options:\n"
 		"\t-r, --read <file>      Read traces in btsnoop format\n"
 		"\t-w, --write <file>     Save traces in btsnoop format\n"
+		"\t-Y, --sync <seconds>   Sync saved traces at interval\n"
+		"\t-R, --rotate-size <MB> Start new trace segment at size\n"
+		"\t-D, --rotate-time <min> Start new trace segment at interval\n"
 		"\t-a, --analyze <file>   Analyze traces in btsnoop format\n"
+		"\t-c, --stats <file>     Count packet types in btsnoop format\n"
+		"\t-x, --build-index <file> Build packet index for btsnoop file\n"
+		"\t-N, --start <num>      Start display at packet number\n"
+		"\t-A, --start-time <sec> Start display at time (seconds)\n"
+		"\t-H, --handle <handle>  Show only specified connection\n"
+		"\t-K, --checkpoint       Save decoder checkpoints while reading\n"
+		"\t-j, --jobs <num>       Render hexdumps on worker threads\n"
+		"\t-o, --output <file>    Write decoded output to file\n"
+		"\t-n, --null-output      Decode without writing any output\n"
+		"\t-b, --records <file>   Write advertising reports as records\n"
 		"\t-s, --server <socket>  Start monitor server socket\n"
+		"\t-F, --fanout <socket>  Forward live traces to local clients\n"
+		"\t-Q, --fanout-queue <num> Packets queued per client\n"
+		"\t-O, --fanout-overflow <policy> drop (default) or disconnect\n"
 		"\t-p, --priority <level> Show only priority or lower\n"
 		"\t-i, --index <num>      Show only specified controller\n"
 		"\t-d, --tty <tty>        Read data from TTY\n"
@@ -73,13 +98,46 @@ static void usage(void)
 		"\t-h, --help             Show help options\n");
 }
 
+/* Accepts a whole decimal, octal or hex number within min and max */
+static bool parse_number(const char *arg, long min, long max, long *val)
+{
+	char *end;
+	long num;
+
+	errno = 0;
+	num = strtol(arg, &end, 0);
+
+	if (errno || end == arg || *end || num < min || num > max)
+		return false;
+
+	*val = num;
+
+	return true;
+}
+
 static const struct option main_options[] = {
 	{ "tty",     required_argument, NULL, 'd' },
 	{ "tty-speed", required_argument, NULL, 'B' },
 	{ "read",    required_argument, NULL, 'r' },
 	{ "write",   required_argument, NULL, 'w' },
+	{ "sync",    required_argument, NULL, 'Y' },
+	{ "rotate-size", required_argument, NULL, 'R' },
+	{ "rotate-time", required_argument, NULL, 'D' },
 	{ "analyze", required_argument, NULL, 'a' },
+	{ "stats",   required_argument, NULL, 'c' },
+	{ "build-index", required_argument, NULL, 'x' },
+	{ "start",   required_argument, NULL, 'N' },
+	{ "start-time", required_argument, NULL, 'A' },
+	{ "handle",  required_argument, NULL, 'H' },
+	{ "checkpoint", no_argument,    NULL, 'K' },
+	{ "jobs",    required_argument, NULL, 'j' },
+	{ "output",  required_argument, NULL, 'o' },
+	{ "null-output", no_argument,   NULL, 'n' },
+	{ "records", required_argument, NULL, 'b' },
 	{ "server",  required_argument, NULL, 's' },
+	{ "fanout",  required_argument, NULL, 'F' },
+	{ "fanout-queue", required_argument, NULL, 'Q' },
+	{ "fanout-overflow", required_argument, NULL, 'O' },
 	{ "priority",required_argument, NULL, 'p' },
 	{ "index",   required_argument, NULL, 'i' },
 	{ "time",    no_argument,       NULL, 't' },
@@ -95,14 +153,34 @@ static const struct option main_options[] = {
 int main(int argc, char *argv[])
 {
 	unsigned long filter_mask = 0;
+	int select_index = -1;
 	const char *reader_path = NULL;
 	const char *writer_path = NULL;
+	unsigned int sync_interval = 0;
+	unsigned int rotate_size = 0;
+	unsigned int rotate_time = 0;
 	const char *analyze_path = NULL;
+	const char *stats_path = NULL;
+	const char *index_path = NULL;
+	unsigned long start_packet = 0;
+	struct timeval start_time = { 0, 0 };
+	int handle = -1;
+	bool checkpoint = false;
+	unsigned int jobs = 0;
+	enum output_sink output_sink = OUTPUT_TERMINAL;
+	const char *output_path = NULL;
+	const char *record_path = NULL;
+	const char *fanout_path = NULL;
+	unsigned int fanout_queue = FANOUT_DEFAULT_QUEUE;
+	enum fanout_policy fanout_policy = FANOUT_DROP_OLDEST;
+	double secs;
 	const char *ellisys_server = NULL;
 	const char *tty = NULL;
 	unsigned int tty_speed = B115200;
 	unsigned short ellisys_port = 0;
 	const char *str;
+	char *end;
+	long num;
 	int exit_status;
 	sigset_t mask;
 
@@ -113,7 +191,7 @@ int main(int argc, char *argv[])
 	for (;;) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "d:r:w:a:s:p:i:tTSE:vh",
+		opt = getopt_long(argc, argv, "d:r:w:Y:R:D:a:c:x:N:A:H:Kj:o:nb:s:F:Q:O:p:i:tTSE:vh",
 						main_options, NULL);
 		if (opt < 0)
 			break;
@@ -135,12 +213,106 @@ int main(int argc, char *argv[])
 		case 'w':
 			writer_path = optarg;
 			break;
+		case 'Y':
+			if (!parse_number(optarg, 0, 86400, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			sync_interval = num;
+			break;
+		case 'R':
+			if (!parse_number(optarg, 0, 1048576, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			rotate_size = num;
+			break;
+		case 'D':
+			if (!parse_number(optarg, 0, 525600, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			rotate_time = num;
+			break;
 		case 'a':
 			analyze_path = optarg;
 			break;
+		case 'c':
+			stats_path = optarg;
+			filter_mask |= PACKET_FILTER_NO_OUTPUT;
+			break;
+		case 'x':
+			index_path = optarg;
+			break;
+		case 'N':
+			if (!parse_number(optarg, 0, LONG_MAX, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			start_packet = num;
+			break;
+		case 'A':
+			errno = 0;
+			secs = strtod(optarg, &end);
+			if (errno || end == optarg || *end || !(secs >= 0) ||
+								secs > INT_MAX) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			start_time.tv_sec = secs;
+			start_time.tv_usec = (secs - start_time.tv_sec) * 1000000;
+			break;
+		case 'H':
+			if (!parse_number(optarg, 0, 0x0eff, &num)) {
+				fprintf(stderr, "Invalid handle: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			handle = num;
+			break;
+		case 'K':
+			checkpoint = true;
+			break;
+		case 'j':
+			if (!parse_number(optarg, 0, RENDER_MAX_JOBS, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			jobs = num;
+			break;
+		case 'o':
+			output_sink = OUTPUT_FILE;
+			output_path = optarg;
+			break;
+		case 'n':
+			output_sink = OUTPUT_NULL;
+			output_path = NULL;
+			break;
+		case 'b':
+			record_path = optarg;
+			break;
 		case 's':
 			control_server(optarg);
 			break;
+		case 'F':
+			fanout_path = optarg;
+			break;
+		case 'Q':
+			if (!parse_number(optarg, 2, 1048576, &num)) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			fanout_queue = num;
+			break;
+		case 'O':
+			if (!strcmp(optarg, "drop"))
+				fanout_policy = FANOUT_DROP_OLDEST;
+			else if (!strcmp(optarg, "disconnect"))
+				fanout_policy = FANOUT_DISCONNECT;
+			else {
+				fprintf(stderr, "Unknown policy: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'p':
 			packet_set_priority(optarg);
 			break;
@@ -153,7 +325,8 @@ int main(int argc, char *argv[])
 				usage();
 				return EXIT_FAILURE;
 			}
-			packet_select_index(atoi(str));
+			select_index = atoi(str);
+			packet_select_index(select_index);
 			break;
 		case 't':
 			filter_mask &= ~PACKET_FILTER_SHOW_TIME_OFFSET;
@@ -196,12 +369,37 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (stats_path && (reader_path || analyze_path)) {
+		fprintf(stderr, "Statistics can't be combined with display "
+						"or analyze\n");
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * Handle selection skips packets of other connections and stops
+	 * early, so snapshots taken during such a run are incomplete.
+	 */
+	if (checkpoint && handle >= 0) {
+		fprintf(stderr, "Checkpoints can't be combined with handle "
+								"selection\n");
+		return EXIT_FAILURE;
+	}
+
+	if (index_path && (reader_path || analyze_path || stats_path)) {
+		fprintf(stderr, "Index building can't be combined with other "
+								"modes\n");
+		return EXIT_FAILURE;
+	}
+
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGINT);
 	sigaddset(&mask, SIGTERM);
 
 	mainloop_set_signal(&mask, signal_callback, NULL, NULL);
 
+	if (!output_open(output_sink, output_path))
+		return EXIT_FAILURE;
+
 	printf("Bluetooth monitor ver %s\n", VERSION);
 
 	keys_setup();
@@ -213,21 +411,54 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
+	if (stats_path) {
+		stats_trace(stats_path);
+		return EXIT_SUCCESS;
+	}
+
+	if (index_path) {
+		if (!pktindex_build(index_path))
+			return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
+
+	if (record_path && !record_open(record_path))
+		return EXIT_FAILURE;
+
 	if (reader_path) {
+		control_reader_select(start_packet, &start_time, select_index,
+									handle);
+		control_reader_checkpoint(checkpoint);
+		control_reader_jobs(jobs);
+
 		if (ellisys_server)
-			ellisys_enable(ellisys_server, ellisys_port);
+			ellisys_enable(ellisys_server, ellisys_port,
+								ELLISYS_BLOCK);
 
 		control_reader(reader_path);
+
+		ellisys_disable();
+		ellisys_print_stats();
+
+		record_close();
+
 		return EXIT_SUCCESS;
 	}
 
-	if (writer_path && !control_writer(writer_path)) {
+	if (writer_path && !control_writer(writer_path, sync_interval,
+						rotate_size, rotate_time)) {
 		printf("Failed to open '%s'\n", writer_path);
 		return EXIT_FAILURE;
 	}
 
+	if (fanout_path && !fanout_open(fanout_path, fanout_queue,
+							fanout_policy)) {
+		printf("Failed to open '%s'\n", fanout_path);
+		return EXIT_FAILURE;
+	}
+
 	if (ellisys_server)
-		ellisys_enable(ellisys_server, ellisys_port);
+		ellisys_enable(ellisys_server, ellisys_port, ELLISYS_DROP);
 
 	if (!tty && control_tracing() < 0)
 		return EXIT_FAILURE;
@@ -235,8 +466,20 @@ int main(int argc, char *argv[])
 	if (tty && control_tty(tty, tty_speed) < 0)
 		return EXIT_FAILURE;
 
+	output_flush();
+
 	exit_status = mainloop_run();
 
+	control_print_stats();
+	fanout_print_stats();
+	control_cleanup();
+	fanout_close();
+
+	ellisys_disable();
+	ellisys_print_stats();
+
+	record_close();
+
 	keys_cleanup();
 
 	return exit_status;
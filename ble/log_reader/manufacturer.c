@@ -0,0 +1,102 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "src/shared/util.h"
+
+#include "manufacturer.h"
+
+/*
+ * Parsers for manufacturer specific data formats with public
+ * specifications. They only extract the fields, printing is left to
+ * the decoders in packet.c.
+ */
+
+bool ruuvi_parse(const void *data, uint8_t data_len, struct ruuvi_data *ruuvi)
+{
+	const uint8_t *ptr = data;
+	uint16_t power;
+
+	if (data_len < 1)
+		return false;
+
+	memset(ruuvi, 0, sizeof(*ruuvi));
+	ruuvi->format = ptr[0];
+
+	switch (ptr[0]) {
+	case 0x03:
+		if (data_len < 14)
+			return false;
+
+		/* Sign and magnitude, with the fraction in 1/100 degree */
+		ruuvi->temperature = (ptr[2] & 0x7f) * 1000 + ptr[3] * 10;
+		if (ptr[2] & 0x80)
+			ruuvi->temperature = -ruuvi->temperature;
+
+		ruuvi->humidity = ptr[1] * 5000;
+		ruuvi->pressure = get_be16(ptr + 4) + 50000;
+		ruuvi->accel[0] = get_be16(ptr + 6);
+		ruuvi->accel[1] = get_be16(ptr + 8);
+		ruuvi->accel[2] = get_be16(ptr + 10);
+		ruuvi->battery = get_be16(ptr + 12);
+		return true;
+
+	case 0x05:
+		if (data_len < 24)
+			return false;
+
+		power = get_be16(ptr + 13);
+
+		ruuvi->temperature = (int16_t) get_be16(ptr + 1) * 5;
+		ruuvi->humidity = get_be16(ptr + 3) * 25;
+		ruuvi->pressure = get_be16(ptr + 5) + 50000;
+		ruuvi->accel[0] = get_be16(ptr + 7);
+		ruuvi->accel[1] = get_be16(ptr + 9);
+		ruuvi->accel[2] = get_be16(ptr + 11);
+		ruuvi->battery = (power >> 5) + 1600;
+		ruuvi->tx_power = (power & 0x1f) * 2 - 40;
+		ruuvi->movement = ptr[15];
+		ruuvi->sequence = get_be16(ptr + 16);
+		memcpy(ruuvi->mac, ptr + 18, sizeof(ruuvi->mac));
+		return true;
+	}
+
+	return false;
+}
+
+bool altbeacon_parse(const void *data, uint8_t data_len,
+					struct altbeacon_data *beacon)
+{
+	const uint8_t *ptr = data;
+
+	if (data_len < 24 || get_be16(ptr) != 0xbeac)
+		return false;
+
+	memcpy(beacon->id, ptr + 2, sizeof(beacon->id));
+	beacon->ref_rssi = ptr[22];
+	beacon->reserved = ptr[23];
+
+	return true;
+}
@@ -0,0 +1,50 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Sensor values from a Ruuvi RAWv1 (3) or RAWv2 (5) payload, scaled to
+ * integers. tx_power, movement, sequence and mac are only present in
+ * RAWv2.
+ */
+struct ruuvi_data {
+	uint8_t format;
+	int32_t temperature;	/* 1/1000 degree Celsius */
+	uint32_t humidity;	/* 1/10000 percent */
+	uint32_t pressure;	/* Pa */
+	int16_t accel[3];	/* mG */
+	uint16_t battery;	/* mV */
+	int8_t tx_power;	/* dBm */
+	uint8_t movement;
+	uint16_t sequence;
+	uint8_t mac[6];
+};
+
+struct altbeacon_data {
+	uint8_t id[20];
+	int8_t ref_rssi;
+	uint8_t reserved;
+};
+
+bool ruuvi_parse(const void *data, uint8_t data_len, struct ruuvi_data *ruuvi);
+bool altbeacon_parse(const void *data, uint8_t data_len,
+					struct altbeacon_data *beacon);
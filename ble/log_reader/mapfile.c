@@ -0,0 +1,142 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "mapfile.h"
+
+#define MAP_HDR_SIZE	16
+#define MAP_PKT_SIZE	24
+
+/*
+ * Map uncompressed monitor format traces directly. Anything else, such
+ * as other btsnoop formats, PacketLogger files, pipes or compressed
+ * input, is left to the regular btsnoop reader.
+ */
+bool map_open(const char *path, struct map_file *map)
+{
+	struct stat st;
+	void *base;
+	int fd;
+
+	memset(map, 0, sizeof(*map));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+				st.st_size < MAP_HDR_SIZE ||
+				(uint64_t) st.st_size > SIZE_MAX) {
+		close(fd);
+		return false;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (base == MAP_FAILED)
+		return false;
+
+	if (memcmp(base, "btsnoop\0", 8) ||
+			get_be32(base + 8) != 1 ||
+			get_be32(base + 12) != BTSNOOP_FORMAT_MONITOR) {
+		munmap(base, st.st_size);
+		return false;
+	}
+
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+	map->base = base;
+	map->size = st.st_size;
+	map->offset = MAP_HDR_SIZE;
+
+	return true;
+}
+
+void map_close(struct map_file *map)
+{
+	if (!map->base)
+		return;
+
+	munmap(map->base, map->size);
+	map->base = NULL;
+}
+
+bool map_seek(struct map_file *map, uint64_t offset)
+{
+	if (offset < MAP_HDR_SIZE || offset > map->size)
+		return false;
+
+	map->offset = offset;
+
+	return true;
+}
+
+bool map_read_hci(struct map_file *map, struct timeval *tv,
+				uint16_t *index, uint16_t *opcode,
+				const void **data, uint16_t *size)
+{
+	const uint8_t *pkt;
+	uint32_t len, flags;
+	uint64_t ts;
+
+	if (map->size - map->offset < MAP_PKT_SIZE)
+		return false;
+
+	pkt = map->base + map->offset;
+
+	len = get_be32(pkt);
+	flags = get_be32(pkt + 8);
+	ts = get_be64(pkt + 16) - 0x00E03AB44A676000ll;
+
+	if (len > BTSNOOP_MAX_PACKET_SIZE) {
+		fprintf(stderr, "Packet len suspiciously big: %u\n", len);
+		return false;
+	}
+
+	if (map->size - map->offset - MAP_PKT_SIZE < len)
+		return false;
+
+	tv->tv_sec = (ts / 1000000ll) + 946684800ll;
+	tv->tv_usec = ts % 1000000ll;
+
+	*index = flags >> 16;
+	*opcode = flags & 0xffff;
+	*data = pkt + MAP_PKT_SIZE;
+	*size = len;
+
+	map->offset += MAP_PKT_SIZE + len;
+
+	return true;
+}
@@ -0,0 +1,139 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/*
+ * All decoder output goes through stdout, which is pointed at the chosen
+ * sink and given one large buffer, so millions of small print_field()
+ * calls end up as a few big writes. Only the main thread decodes and
+ * prints, so stdio locking is turned off as well. The one exception is
+ * the hexdump pipeline in render.c, whose emitter thread writes to this
+ * stream, and which turns locking back on while it runs.
+ *
+ * The colour decision stays with use_color(), which looks at the file
+ * descriptor and therefore drops colour codes for file and null sinks.
+ * Live tracing calls output_flush() once per batch of packets.
+ *
+ * Output can be suspended, which points stdout at /dev/null until the
+ * matching resume. Stats mode suspends it for the whole trace and a
+ * selection suspends it for the packets it skips. Suspends nest, so a
+ * selection toggling its own has no effect while stats mode holds one.
+ */
+#define OUTPUT_BUFFER_SIZE	(1024 * 1024)
+
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+static unsigned int suspend_count = 0;
+static int null_fd = -1;
+static int saved_fd = -1;
+
+bool output_open(enum output_sink sink, const char *path)
+{
+	int fd;
+
+	switch (sink) {
+	case OUTPUT_TERMINAL:
+		break;
+	case OUTPUT_FILE:
+	case OUTPUT_NULL:
+		if (sink == OUTPUT_NULL)
+			path = "/dev/null";
+
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+									0644);
+		if (fd < 0) {
+			perror("Failed to open output");
+			return false;
+		}
+
+		if (dup2(fd, STDOUT_FILENO) < 0) {
+			perror("Failed to redirect output");
+			close(fd);
+			return false;
+		}
+
+		close(fd);
+		break;
+	}
+
+	if (setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer)))
+		return false;
+
+	__fsetlocking(stdout, FSETLOCKING_BYCALLER);
+
+	return true;
+}
+
+void output_flush(void)
+{
+	fflush(stdout);
+}
+
+void output_suspend(void)
+{
+	if (suspend_count++)
+		return;
+
+	if (null_fd < 0) {
+		null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		if (null_fd < 0) {
+			perror("Failed to open /dev/null");
+			return;
+		}
+
+		saved_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		if (saved_fd < 0) {
+			perror("Failed to duplicate output");
+			close(null_fd);
+			null_fd = -1;
+			return;
+		}
+	}
+
+	fflush(stdout);
+	dup2(null_fd, STDOUT_FILENO);
+}
+
+void output_resume(void)
+{
+	if (!suspend_count || --suspend_count)
+		return;
+
+	if (saved_fd < 0)
+		return;
+
+	fflush(stdout);
+	dup2(saved_fd, STDOUT_FILENO);
+}
+
+bool output_suspended(void)
+{
+	return suspend_count > 0;
+}
@@ -44,13 +44,21 @@
 
 #include "bt.h"
 #include "ll.h"
+#include "l2cap.h"
 #include "hwdb.h"
+#include "hash.h"
+#include "checkpoint.h"
 #include "keys.h"
 #include "uuid.h"
 #include "control.h"
 #include "vendor.h"
 #include "intel.h"
 #include "broadcom.h"
+#include "ad.h"
+#include "manufacturer.h"
+#include "hex.h"
+#include "render.h"
+#include "record.h"
 #include "packet.h"
 
 #define COLOR_INDEX_LABEL		COLOR_WHITE
@@ -91,53 +99,252 @@ static uint16_t index_current = 0;
 
 #define UNKNOWN_MANUFACTURER 0xffff
 
-#define MAX_CONN 16
+static struct timeval time_current;
 
-struct conn_data {
-	uint16_t handle;
-	uint8_t  type;
-};
-
-static struct conn_data conn_list[MAX_CONN];
+static struct hash **conn_tables = NULL;
+static uint32_t num_conn_tables = 0;
 
-static void assign_handle(uint16_t handle, uint8_t type)
+static struct hash *get_conn_table(uint16_t index, bool create)
 {
-	int i;
+	struct hash **tables;
+	uint32_t num;
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == 0x0000) {
-			conn_list[i].handle = handle;
-			conn_list[i].type = type;
-			break;
-		}
+	if (index < num_conn_tables && conn_tables[index])
+		return conn_tables[index];
+
+	if (!create)
+		return NULL;
+
+	if (index >= num_conn_tables) {
+		num = index + 1;
+
+		tables = realloc(conn_tables, num * sizeof(*tables));
+		if (!tables)
+			return NULL;
+
+		memset(tables + num_conn_tables, 0,
+				(num - num_conn_tables) * sizeof(*tables));
+
+		conn_tables = tables;
+		num_conn_tables = num;
 	}
+
+	conn_tables[index] = hash_new();
+
+	return conn_tables[index];
 }
 
-static void release_handle(uint16_t handle)
+static struct packet_conn_data *conn_lookup(uint16_t index, uint16_t handle,
+								bool create)
 {
-	int i;
+	struct hash *table;
+	struct packet_conn_data *conn;
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == handle) {
-			conn_list[i].handle = 0x0000;
-			conn_list[i].type = 0x00;
-			break;
-		}
+	table = get_conn_table(index, create);
+	if (!table)
+		return NULL;
+
+	conn = hash_lookup(table, handle);
+	if (conn || !create)
+		return conn;
+
+	conn = new0(struct packet_conn_data, 1);
+	if (!conn)
+		return NULL;
+
+	conn->index = index;
+	conn->handle = handle;
+	conn->type = 0xff;
+
+	if (!hash_insert(table, handle, conn)) {
+		free(conn);
+		return NULL;
 	}
+
+	return conn;
 }
 
-static uint8_t get_type(uint16_t handle)
+static void conn_remove(uint16_t index, uint16_t handle)
 {
-	int i;
+	free(hash_remove(get_conn_table(index, false), handle));
+}
+
+static void release_handle(uint16_t index, uint16_t handle)
+{
+	conn_remove(index, handle);
+	l2cap_release_conn(index, handle);
+}
+
+static void assign_handle(uint16_t index, uint16_t handle, uint8_t type)
+{
+	struct packet_conn_data *conn;
+
+	/* A stale entry for a reused handle must not leak its state */
+	release_handle(index, handle);
+
+	conn = conn_lookup(index, handle, true);
+	if (conn)
+		conn->type = type;
+}
+
+static uint8_t get_type(uint16_t index, uint16_t handle)
+{
+	struct packet_conn_data *conn;
+
+	conn = conn_lookup(index, handle, false);
+	if (!conn)
+		return 0xff;
+
+	return conn->type;
+}
+
+/*
+ * Connections are entered on their first data packet, since traces
+ * often start with links already up and no connection complete event
+ * for them. The entry type stays unknown until assign_handle() sets it,
+ * which also resets the counters when a handle is reused.
+ */
+void packet_conn_account(uint16_t index, uint16_t handle, bool in,
+								uint16_t size)
+{
+	struct packet_conn_data *conn;
+
+	conn = conn_lookup(index, handle, true);
+	if (!conn)
+		return;
+
+	if (!conn->packets[0] && !conn->packets[1])
+		conn->first_seen = time_current;
+
+	conn->last_seen = time_current;
+	conn->packets[in]++;
+	conn->bytes[in] += size;
+}
+
+struct conn_foreach_data {
+	packet_conn_func_t func;
+	void *user_data;
+};
+
+static void conn_foreach(uint64_t key, void *value, void *user_data)
+{
+	struct conn_foreach_data *data = user_data;
+
+	data->func(value, data->user_data);
+}
+
+void packet_conn_foreach(packet_conn_func_t func, void *user_data)
+{
+	struct conn_foreach_data data = { func, user_data };
+	uint32_t i;
+
+	for (i = 0; i < num_conn_tables; i++)
+		hash_foreach(conn_tables[i], conn_foreach, &data);
+}
+
+static void save_conn(uint64_t key, void *value, void *user_data)
+{
+	checkpoint_put(user_data, value, sizeof(struct packet_conn_data));
+}
 
-	for (i = 0; i < MAX_CONN; i++) {
-		if (conn_list[i].handle == handle)
-			return conn_list[i].type;
+void packet_save_state(struct checkpoint *ckpt)
+{
+	uint32_t i, count = 0;
+
+	checkpoint_put(ckpt, &time_offset, sizeof(time_offset));
+
+	for (i = 0; i < num_conn_tables; i++)
+		count += hash_count(conn_tables[i]);
+
+	checkpoint_put_u32(ckpt, count);
+
+	for (i = 0; i < num_conn_tables; i++)
+		hash_foreach(conn_tables[i], save_conn, ckpt);
+}
+
+bool packet_restore_state(struct checkpoint *ckpt)
+{
+	struct packet_conn_data data, *conn;
+	uint32_t i, count;
+
+	for (i = 0; i < num_conn_tables; i++)
+		hash_destroy(conn_tables[i], free);
+
+	free(conn_tables);
+	conn_tables = NULL;
+	num_conn_tables = 0;
+
+	if (!checkpoint_get(ckpt, &time_offset, sizeof(time_offset)))
+		return false;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (!checkpoint_get(ckpt, &data, sizeof(data)))
+			return false;
+
+		conn = conn_lookup(data.index, data.handle, true);
+		if (!conn)
+			return false;
+
+		*conn = data;
 	}
 
-	return 0xff;
+	return true;
+}
+
+bool packet_has_filter(unsigned long filter)
+{
+	return filter_mask & filter;
+}
+
+void packet_set_time(const struct timeval *tv)
+{
+	if (tv)
+		time_current = *tv;
+	else
+		gettimeofday(&time_current, NULL);
+}
+
+const struct timeval *packet_get_time(void)
+{
+	return &time_current;
 }
 
+uint64_t packet_elapsed_usec(const struct timeval *start,
+						const struct timeval *end)
+{
+	struct timeval res;
+
+	timersub(end, start, &res);
+	if (res.tv_sec < 0)
+		return 0;
+
+	return res.tv_sec * 1000000ULL + res.tv_usec;
+}
+
+/*
+ * Local time only changes once a second, so the broken-down time is
+ * kept for the current second instead of calling localtime_r() for
+ * every packet.
+ */
+static struct {
+	time_t sec;
+	struct tm tm;
+} time_cache = {
+	.sec = ((time_t) -1),
+};
+
+const struct tm *packet_local_time(time_t sec)
+{
+	if (sec != time_cache.sec) {
+		localtime_r(&sec, &time_cache.tm);
+		time_cache.sec = sec;
+	}
+
+	return &time_cache.tm;
+}
 
 static const struct {
 	uint8_t error;
@@ -326,6 +533,7 @@ static void print_addr_resolve(const char *label, const uint8_t *addr,
 {
 	const char *str;
 	char *company;
+	char addr_str[HEX_ADDR_SIZE], oui[9];
 
 	switch (addr_type) {
 	case 0x00:
@@ -333,19 +541,17 @@ static void print_addr_resolve(const char *label, const uint8_t *addr,
 		if (!hwdb_get_company(addr, &company))
 			company = NULL;
 
+		hex_addr2str(addr, addr_str);
+
 		if (company) {
-			print_field("%s: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X"
-					" (%s)", label, addr[5], addr[4],
-							addr[3], addr[2],
-							addr[1], addr[0],
-							company);
+			print_field("%s: %s (%s)", label, addr_str, company);
 			free(company);
 		} else {
-			print_field("%s: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X"
-					" (OUI %2.2X-%2.2X-%2.2X)", label,
-						addr[5], addr[4], addr[3],
-						addr[2], addr[1], addr[0],
-						addr[5], addr[4], addr[3]);
+			memcpy(oui, addr_str, 8);
+			oui[2] = '-';
+			oui[5] = '-';
+			oui[8] = '\0';
+			print_field("%s: %s (OUI %s)", label, addr_str, oui);
 		}
 		break;
 	case 0x01:
@@ -365,9 +571,8 @@ static void print_addr_resolve(const char *label, const uint8_t *addr,
 			break;
 		}
 
-		print_field("%s: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X (%s)",
-					label, addr[5], addr[4], addr[3],
-					addr[2], addr[1], addr[0], str);
+		hex_addr2str(addr, addr_str);
+		print_field("%s: %s (%s)", label, addr_str, str);
 
 		if (resolve && (addr[5] & 0xc0) == 0x40) {
 			uint8_t ident[6], ident_type;
@@ -1511,7 +1716,7 @@ static void print_encr_mode_change(uint8_t encr_mode, uint16_t handle)
 	const char *str;
 	uint8_t conn_type;
 
-	conn_type = get_type(le16_to_cpu(handle));
+	conn_type = get_type(index_current, le16_to_cpu(handle));
 
 	switch (encr_mode) {
 	case 0x00:
@@ -1646,6 +1851,9 @@ static void print_hex_field(const char *label, const uint8_t *data,
 	char str[len * 2 + 1];
 	uint8_t i;
 
+	if (filter_mask & PACKET_FILTER_NO_OUTPUT)
+		return;
+
 	str[0] = '\0';
 
 	for (i = 0; i < len; i++)
@@ -2935,21 +3143,175 @@ static void print_manufacturer_apple(const void *data, uint8_t data_len)
 	packet_hexdump(data, data_len);
 }
 
-static void print_manufacturer_data(const void *data, uint8_t data_len)
+static void print_manufacturer_microsoft(const void *data, uint8_t data_len)
 {
-	uint16_t company = get_le16(data);
+	const uint8_t *ptr = data;
+	uint8_t scenario;
+	const char *str;
+
+	/* Only the Swift Pair beacon is decoded */
+	if (ptr[0] != 0x03) {
+		print_field("  Beacon ID: 0x%2.2x", ptr[0]);
+		print_hex_field("  Data", ptr + 1, data_len - 1);
+		return;
+	}
 
-	packet_print_company("Company", company);
+	scenario = ptr[1];
 
-	switch (company) {
-	case 76:
-	case 19456:
-		print_manufacturer_apple(data + 2, data_len - 2);
+	switch (scenario) {
+	case 0x00:
+		str = "Swift Pair (LE)";
+		break;
+	case 0x01:
+		str = "Swift Pair (LE and BR/EDR)";
+		break;
+	case 0x02:
+		str = "Swift Pair (BR/EDR)";
 		break;
 	default:
-		print_hex_field("  Data", data + 2, data_len - 2);
+		str = "Reserved";
 		break;
 	}
+
+	print_field("  Scenario: %s (0x%2.2x)", str, scenario);
+	print_field("  Reserved RSSI: 0x%2.2x", ptr[2]);
+
+	ptr += 3;
+	data_len -= 3;
+
+	if (scenario > 0x02) {
+		print_hex_field("  Data", ptr, data_len);
+		return;
+	}
+
+	/* BR/EDR only pairing carries the BR/EDR address and class */
+	if (scenario == 0x02) {
+		if (data_len < 9) {
+			print_hex_field("  Data", ptr, data_len);
+			return;
+		}
+
+		print_addr("  BR/EDR Address", ptr, 0x00);
+		print_field("  Class: 0x%2.2x%2.2x%2.2x", ptr[8], ptr[7],
+								ptr[6]);
+		ptr += 9;
+		data_len -= 9;
+	}
+
+	if (data_len)
+		print_field("  Display Name: %.*s", data_len, ptr);
+}
+
+static void print_manufacturer_altbeacon(const void *data, uint8_t data_len)
+{
+	struct altbeacon_data beacon;
+
+	if (!altbeacon_parse(data, data_len, &beacon)) {
+		print_hex_field("  Data", data, data_len);
+		return;
+	}
+
+	print_field("  Type: AltBeacon");
+	print_hex_field("  Beacon ID", beacon.id, sizeof(beacon.id));
+	print_field("  Reference RSSI: %d dBm", beacon.ref_rssi);
+	print_field("  Reserved: 0x%2.2x", beacon.reserved);
+
+	if (data_len > 24)
+		packet_hexdump(data + 24, data_len - 24);
+}
+
+static void print_manufacturer_ruuvi(const void *data, uint8_t data_len)
+{
+	struct ruuvi_data ruuvi;
+	const char *sign;
+	uint32_t temp;
+
+	if (!ruuvi_parse(data, data_len, &ruuvi)) {
+		print_hex_field("  Data", data, data_len);
+		return;
+	}
+
+	sign = ruuvi.temperature < 0 ? "-" : "";
+	temp = ruuvi.temperature < 0 ? -ruuvi.temperature : ruuvi.temperature;
+
+	if (ruuvi.format == 0x03) {
+		print_field("  Data Format: RAWv1 (3)");
+		print_field("  Humidity: %u.%u %%", ruuvi.humidity / 10000,
+					ruuvi.humidity % 10000 / 1000);
+		print_field("  Temperature: %s%u.%02u C", sign, temp / 1000,
+							temp % 1000 / 10);
+	} else {
+		print_field("  Data Format: RAWv2 (5)");
+		print_field("  Temperature: %s%u.%03u C", sign, temp / 1000,
+								temp % 1000);
+		print_field("  Humidity: %u.%04u %%", ruuvi.humidity / 10000,
+						ruuvi.humidity % 10000);
+	}
+
+	print_field("  Pressure: %u Pa", ruuvi.pressure);
+	print_field("  Acceleration: %d %d %d mG", ruuvi.accel[0],
+					ruuvi.accel[1], ruuvi.accel[2]);
+	print_field("  Battery: %u mV", ruuvi.battery);
+
+	if (ruuvi.format == 0x03)
+		return;
+
+	print_field("  TX power: %d dBm", ruuvi.tx_power);
+	print_field("  Movement Counter: %u", ruuvi.movement);
+	print_field("  Sequence Number: %u", ruuvi.sequence);
+	print_field("  MAC: %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
+					ruuvi.mac[0], ruuvi.mac[1], ruuvi.mac[2],
+					ruuvi.mac[3], ruuvi.mac[4], ruuvi.mac[5]);
+}
+
+/*
+ * Manufacturer specific data decoders, dispatched on the company
+ * identifier through manufacturer_index. Payloads shorter than the
+ * minimum size are shown as hex like unknown companies.
+ */
+static const struct {
+	uint16_t company;
+	uint8_t min_size;
+	void (*func) (const void *data, uint8_t data_len);
+} manufacturer_table[] = {
+	{     6,  3, print_manufacturer_microsoft	},
+	{    76,  1, print_manufacturer_apple		},
+	{   280, 24, print_manufacturer_altbeacon	},
+	{  1177,  1, print_manufacturer_ruuvi		},
+	{ 19456,  1, print_manufacturer_apple		},
+	{ }
+};
+
+/* Position in manufacturer_table plus one, zero for no decoder */
+static uint8_t manufacturer_index[UINT16_MAX + 1];
+static bool manufacturer_ready = false;
+
+static void init_manufacturer_index(void)
+{
+	int i;
+
+	for (i = 0; manufacturer_table[i].func; i++)
+		manufacturer_index[manufacturer_table[i].company] = i + 1;
+
+	manufacturer_ready = true;
+}
+
+static void print_manufacturer_data(const struct ad_payload *payload)
+{
+	uint8_t index;
+
+	packet_print_company("Company", payload->id);
+
+	if (!manufacturer_ready)
+		init_manufacturer_index();
+
+	index = manufacturer_index[payload->id];
+	if (!index || payload->len < manufacturer_table[index - 1].min_size) {
+		print_hex_field("  Data", payload->data, payload->len);
+		return;
+	}
+
+	manufacturer_table[index - 1].func(payload->data, payload->len);
 }
 
 static void print_device_id(const void *data, uint8_t data_len)
@@ -3013,49 +3375,34 @@ static void print_device_id(const void *data, uint8_t data_len)
 	free(product_str);
 }
 
-static void print_uuid16_list(const char *label, const void *data,
-							uint8_t data_len)
+static void print_uuid_list(const char *label,
+					const struct ad_uuid_list *list)
 {
-	uint8_t count = data_len / sizeof(uint16_t);
+	const uint8_t *uuid = list->data;
 	unsigned int i;
 
-	print_field("%s: %u entr%s", label, count, count == 1 ? "y" : "ies");
-
-	for (i = 0; i < count; i++) {
-		uint16_t uuid = get_le16(data + (i * 2));
-		print_field("  %s (0x%4.4x)", uuid16_to_str(uuid), uuid);
-	}
-}
-
-static void print_uuid32_list(const char *label, const void *data,
-							uint8_t data_len)
-{
-	uint8_t count = data_len / sizeof(uint32_t);
-	unsigned int i;
+	print_field("%s: %u entr%s", label, list->count,
+					list->count == 1 ? "y" : "ies");
 
-	print_field("%s: %u entr%s", label, count, count == 1 ? "y" : "ies");
-
-	for (i = 0; i < count; i++) {
-		uint32_t uuid = get_le32(data + (i * 4));
-		print_field("  %s (0x%8.8x)", uuid32_to_str(uuid), uuid);
-	}
-}
-
-static void print_uuid128_list(const char *label, const void *data,
-							uint8_t data_len)
-{
-	uint8_t count = data_len / 16;
-	unsigned int i;
-
-	print_field("%s: %u entr%s", label, count, count == 1 ? "y" : "ies");
-
-	for (i = 0; i < count; i++) {
-		const uint8_t *uuid = data + (i * 16);
-
-		print_field("  %8.8x-%4.4x-%4.4x-%4.4x-%8.8x%4.4x",
+	for (i = 0; i < list->count; i++, uuid += list->size) {
+		switch (list->size) {
+		case 2:
+			print_field("  %s (0x%4.4x)",
+					uuid16_to_str(get_le16(uuid)),
+					get_le16(uuid));
+			break;
+		case 4:
+			print_field("  %s (0x%8.8x)",
+					uuid32_to_str(get_le32(uuid)),
+					get_le32(uuid));
+			break;
+		case 16:
+			print_field("  %8.8x-%4.4x-%4.4x-%4.4x-%8.8x%4.4x",
 				get_le32(&uuid[12]), get_le16(&uuid[10]),
 				get_le16(&uuid[8]), get_le16(&uuid[6]),
 				get_le32(&uuid[2]), get_le16(&uuid[0]));
+			break;
+		}
 	}
 }
 
@@ -3082,38 +3429,41 @@ static const struct {
 	{ }
 };
 
+static void print_uuids(const char *label, const struct ad_field *field)
+{
+	struct ad_uuid_list list;
+
+	if (ad_get_uuids(field, &list))
+		print_uuid_list(label, &list);
+}
+
 static void print_eir(const uint8_t *eir, uint8_t eir_len, bool le)
 {
-	uint16_t len = 0;
+	struct ad_iter iter;
+	struct ad_field field;
+	struct ad_payload payload;
+	const uint8_t *trailing;
+	uint8_t trailing_len;
 
-	if (eir_len == 0)
-		return;
+	ad_iter_init(&iter, eir, eir_len);
 
-	while (len < eir_len - 1) {
-		uint8_t field_len = eir[0];
-		const uint8_t *data = &eir[2];
-		uint8_t data_len;
-		char name[239], label[100];
+	while (ad_iter_next(&iter, &field)) {
+		const uint8_t *data = field.data;
+		uint8_t data_len = field.len;
+		const char *name;
+		uint8_t name_len;
+		char label[100];
 		uint8_t flags, mask;
+		int8_t power;
 		int i;
 
-		/* Check for the end of EIR */
-		if (field_len == 0)
-			break;
-
-		len += field_len + 1;
+		record_ad(&field);
 
-		/* Do not continue EIR Data parsing if got incorrect length */
-		if (len > eir_len) {
-			len -= field_len + 1;
-			break;
-		}
-
-		data_len = field_len - 1;
-
-		switch (eir[1]) {
+		switch (field.type) {
 		case BT_EIR_FLAGS:
-			flags = *data;
+			if (!ad_get_flags(&field, &flags))
+				break;
+
 			mask = flags;
 
 			print_field("Flags: 0x%2.2x", flags);
@@ -3132,63 +3482,45 @@ static void print_eir(const uint8_t *eir, uint8_t eir_len, bool le)
 			break;
 
 		case BT_EIR_UUID16_SOME:
-			if (data_len < sizeof(uint16_t))
-				break;
-			print_uuid16_list("16-bit Service UUIDs (partial)",
-							data, data_len);
+			print_uuids("16-bit Service UUIDs (partial)", &field);
 			break;
 
 		case BT_EIR_UUID16_ALL:
-			if (data_len < sizeof(uint16_t))
-				break;
-			print_uuid16_list("16-bit Service UUIDs (complete)",
-							data, data_len);
+			print_uuids("16-bit Service UUIDs (complete)", &field);
 			break;
 
 		case BT_EIR_UUID32_SOME:
-			if (data_len < sizeof(uint32_t))
-				break;
-			print_uuid32_list("32-bit Service UUIDs (partial)",
-							data, data_len);
+			print_uuids("32-bit Service UUIDs (partial)", &field);
 			break;
 
 		case BT_EIR_UUID32_ALL:
-			if (data_len < sizeof(uint32_t))
-				break;
-			print_uuid32_list("32-bit Service UUIDs (complete)",
-							data, data_len);
+			print_uuids("32-bit Service UUIDs (complete)", &field);
 			break;
 
 		case BT_EIR_UUID128_SOME:
-			if (data_len < 16)
-				break;
-			print_uuid128_list("128-bit Service UUIDs (partial)",
-								data, data_len);
+			print_uuids("128-bit Service UUIDs (partial)", &field);
 			break;
 
 		case BT_EIR_UUID128_ALL:
-			if (data_len < 16)
-				break;
-			print_uuid128_list("128-bit Service UUIDs (complete)",
-								data, data_len);
+			print_uuids("128-bit Service UUIDs (complete)", &field);
 			break;
 
 		case BT_EIR_NAME_SHORT:
-			memset(name, 0, sizeof(name));
-			memcpy(name, data, data_len);
-			print_field("Name (short): %s", name);
+			if (ad_get_name(&field, &name, &name_len))
+				print_field("Name (short): %.*s",
+							name_len, name);
 			break;
 
 		case BT_EIR_NAME_COMPLETE:
-			memset(name, 0, sizeof(name));
-			memcpy(name, data, data_len);
-			print_field("Name (complete): %s", name);
+			if (ad_get_name(&field, &name, &name_len))
+				print_field("Name (complete): %.*s",
+							name_len, name);
 			break;
 
 		case BT_EIR_TX_POWER:
-			if (data_len < 1)
+			if (!ad_get_tx_power(&field, &power))
 				break;
-			print_field("TX power: %d dBm", (int8_t) *data);
+			print_field("TX power: %d dBm", power);
 			break;
 
 		case BT_EIR_CLASS_OF_DEV:
@@ -3218,6 +3550,8 @@ static void print_eir(const uint8_t *eir, uint8_t eir_len, bool le)
 			break;
 
 		case BT_EIR_SMP_OOB_FLAGS:
+			if (data_len < 1)
+				break;
 			print_field("SMP OOB Flags: 0x%2.2x", *data);
 			break;
 
@@ -3230,25 +3564,19 @@ static void print_eir(const uint8_t *eir, uint8_t eir_len, bool le)
 			break;
 
 		case BT_EIR_SERVICE_UUID16:
-			if (data_len < sizeof(uint16_t))
-				break;
-			print_uuid16_list("16-bit Service UUIDs",
-							data, data_len);
+			print_uuids("16-bit Service UUIDs", &field);
 			break;
 
 		case BT_EIR_SERVICE_UUID128:
-			if (data_len < 16)
-				break;
-			print_uuid128_list("128-bit Service UUIDs",
-							data, data_len);
+			print_uuids("128-bit Service UUIDs", &field);
 			break;
 
 		case BT_EIR_SERVICE_DATA:
-			if (data_len < 2)
+			if (!ad_get_service_data(&field, &payload))
 				break;
 			sprintf(label, "Service Data (UUID 0x%4.4x)",
-							get_le16(&data[0]));
-			print_hex_field(label, &data[2], data_len - 2);
+								payload.id);
+			print_hex_field(label, payload.data, payload.len);
 			break;
 
 		case BT_EIR_RANDOM_ADDRESS:
@@ -3307,22 +3635,21 @@ static void print_eir(const uint8_t *eir, uint8_t eir_len, bool le)
 			break;
 
 		case BT_EIR_MANUFACTURER_DATA:
-			if (data_len < 2)
+			if (!ad_get_manufacturer_data(&field, &payload))
 				break;
-			print_manufacturer_data(data, data_len);
+			print_manufacturer_data(&payload);
 			break;
 
 		default:
-			sprintf(label, "Unknown EIR field 0x%2.2x", eir[1]);
+			sprintf(label, "Unknown EIR field 0x%2.2x", field.type);
 			print_hex_field(label, data, data_len);
 			break;
 		}
-
-		eir += field_len + 1;
 	}
 
-	if (len < eir_len && eir[0] != 0)
-		packet_hexdump(eir, eir_len - len);
+	trailing_len = ad_iter_trailing(&iter, &trailing);
+	if (trailing_len)
+		packet_hexdump(trailing, trailing_len);
 }
 
 void packet_print_addr(const char *label, const void *data, bool random)
@@ -3384,48 +3711,21 @@ static void print_3d_broadcast(const void *data, uint8_t size)
 
 void packet_hexdump(const unsigned char *buf, uint16_t len)
 {
-	static const char hexdigits[] = "0123456789abcdef";
-	char str[68];
-	uint16_t i;
+	char str[HEX_ROW_SIZE];
+	unsigned int i;
 
-	if (!len)
+	if (!len || (filter_mask & PACKET_FILTER_NO_OUTPUT))
 		return;
 
-	for (i = 0; i < len; i++) {
-		str[((i % 16) * 3) + 0] = hexdigits[buf[i] >> 4];
-		str[((i % 16) * 3) + 1] = hexdigits[buf[i] & 0xf];
-		str[((i % 16) * 3) + 2] = ' ';
-		str[(i % 16) + 49] = isprint(buf[i]) ? buf[i] : '.';
-
-		if ((i + 1) % 16 == 0) {
-			str[47] = ' ';
-			str[48] = ' ';
-			str[65] = '\0';
-			print_text(COLOR_WHITE, "%s", str);
-			str[0] = ' ';
-		}
-	}
+	if (render_hexdump(buf, len))
+		return;
 
-	if (i % 16 > 0) {
-		uint16_t j;
-		for (j = (i % 16); j < 16; j++) {
-			str[(j * 3) + 0] = ' ';
-			str[(j * 3) + 1] = ' ';
-			str[(j * 3) + 2] = ' ';
-			str[j + 49] = ' ';
-		}
-		str[47] = ' ';
-		str[48] = ' ';
-		str[65] = '\0';
+	for (i = 0; i < len; i += HEX_ROW_BYTES) {
+		hex_row(buf + i, len - i, str);
 		print_text(COLOR_WHITE, "%s", str);
 	}
 }
 
-static int addr2str(const uint8_t *addr, char *str)
-{
-	return sprintf(str, "%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
-			addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
-}
 static void le_adv_report_evt(const void *data, uint8_t size)
 {
 	const struct bt_hci_evt_le_adv_report *evt = data;
@@ -3435,6 +3735,11 @@ static void le_adv_report_evt(const void *data, uint8_t size)
 	print_num_reports(evt->num_reports);
 
 report:
+	record_report_begin(packet_get_time());
+	record_u8(RECORD_EVENT_TYPE, evt->event_type);
+	record_u8(RECORD_ADDRESS_TYPE, evt->addr_type);
+	record_data(RECORD_ADDRESS, evt->addr, 6);
+
 	print_adv_event_type(evt->event_type);
 	print_peer_addr_type("Address type", evt->addr_type);
 	print_addr("Address", evt->addr, evt->addr_type);
@@ -3444,6 +3749,9 @@ report:
 	rssi = (int8_t *) (evt->data + evt->data_len);
 	print_rssi(*rssi);
 
+	record_u8(RECORD_RSSI, *rssi);
+	record_report_end();
+
 	evt_len = sizeof(*evt) + evt->data_len + 1;
 
 	if (size > evt_len) {
@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 
@@ -33,4 +34,36 @@
 #define PACKET_FILTER_SHOW_TIME_OFFSET	(1 << 3)
 #define PACKET_FILTER_SHOW_ACL_DATA	(1 << 4)
 #define PACKET_FILTER_SHOW_SCO_DATA	(1 << 5)
+#define PACKET_FILTER_NO_OUTPUT		(1 << 6)
 
+bool packet_has_filter(unsigned long filter);
+
+
+struct packet_conn_data {
+	uint16_t index;
+	uint16_t handle;
+	uint8_t  type;
+	uint64_t packets[2];
+	uint64_t bytes[2];
+	struct timeval first_seen;
+	struct timeval last_seen;
+};
+
+typedef void (*packet_conn_func_t)(struct packet_conn_data *conn,
+							void *user_data);
+
+void packet_conn_account(uint16_t index, uint16_t handle, bool in,
+								uint16_t size);
+void packet_conn_foreach(packet_conn_func_t func, void *user_data);
+
+void packet_set_time(const struct timeval *tv);
+const struct timeval *packet_get_time(void);
+uint64_t packet_elapsed_usec(const struct timeval *start,
+						const struct timeval *end);
+
+const struct tm *packet_local_time(time_t sec);
+
+struct checkpoint;
+
+void packet_save_state(struct checkpoint *ckpt);
+bool packet_restore_state(struct checkpoint *ckpt);
@@ -0,0 +1,503 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "hash.h"
+#include "mapfile.h"
+#include "pktindex.h"
+
+/*
+ * The index is a text file stored next to the trace as <trace>.idx.
+ * It records the first packet of every second of capture time, so a
+ * start time can be turned into a packet number, and for every ACL and
+ * SCO connection handle the range of packets it appears in. Seeking to
+ * a packet with the right protocol state is done from the checkpoints
+ * written with -K, which carry their own file offsets.
+ *
+ * The size and modification time of the trace are stored as well, and
+ * an index that no longer matches its trace is not used.
+ */
+struct pktindex_bucket {
+	time_t sec;
+	unsigned long num;
+};
+
+struct pktindex_handle {
+	uint16_t index;
+	uint16_t handle;
+	unsigned long first;
+	unsigned long last;
+	unsigned long count;
+};
+
+struct pktindex_trace {
+	unsigned long long size;
+	long sec;
+	long nsec;
+};
+
+struct pktindex {
+	struct pktindex_trace trace;
+	unsigned long packets;
+	struct pktindex_bucket *buckets;
+	unsigned int num_buckets;
+	unsigned int max_buckets;
+	struct hash *handles;
+};
+
+static bool get_trace(const char *path, struct pktindex_trace *trace)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return false;
+
+	trace->size = st.st_size;
+	trace->sec = st.st_mtim.tv_sec;
+	trace->nsec = st.st_mtim.tv_nsec;
+
+	return true;
+}
+
+static bool grow(void **array, unsigned int count, unsigned int *alloc,
+								size_t size)
+{
+	unsigned int new_alloc;
+	void *new_array;
+
+	if (count < *alloc)
+		return true;
+
+	new_alloc = *alloc ? *alloc * 2 : 64;
+
+	new_array = realloc(*array, new_alloc * size);
+	if (!new_array)
+		return false;
+
+	*array = new_array;
+	*alloc = new_alloc;
+
+	return true;
+}
+
+static bool add_bucket(struct pktindex *idx, time_t sec, unsigned long num)
+{
+	struct pktindex_bucket *bucket;
+
+	if (idx->num_buckets &&
+			idx->buckets[idx->num_buckets - 1].sec >= sec)
+		return true;
+
+	if (!grow((void **) &idx->buckets, idx->num_buckets,
+				&idx->max_buckets, sizeof(*bucket)))
+		return false;
+
+	bucket = &idx->buckets[idx->num_buckets++];
+	bucket->sec = sec;
+	bucket->num = num;
+
+	return true;
+}
+
+static struct pktindex_handle *get_handle(struct pktindex *idx,
+					uint16_t index, uint16_t handle)
+{
+	uint64_t key = ((uint64_t) index << 16) | handle;
+	struct pktindex_handle *entry;
+
+	entry = hash_lookup(idx->handles, key);
+	if (entry)
+		return entry;
+
+	entry = new0(struct pktindex_handle, 1);
+	if (!entry)
+		return NULL;
+
+	entry->index = index;
+	entry->handle = handle;
+
+	if (!hash_insert(idx->handles, key, entry)) {
+		free(entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+static bool add_handle(struct pktindex *idx, uint16_t index,
+				uint16_t handle, unsigned long num)
+{
+	struct pktindex_handle *entry;
+
+	entry = get_handle(idx, index, handle);
+	if (!entry)
+		return false;
+
+	if (!entry->count)
+		entry->first = num;
+
+	entry->last = num;
+	entry->count++;
+
+	return true;
+}
+
+static struct pktindex *pktindex_new(void)
+{
+	struct pktindex *idx;
+
+	idx = new0(struct pktindex, 1);
+	if (!idx)
+		return NULL;
+
+	idx->handles = hash_new();
+	if (!idx->handles) {
+		free(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+void pktindex_free(struct pktindex *idx)
+{
+	if (!idx)
+		return;
+
+	hash_destroy(idx->handles, free);
+	free(idx->buckets);
+	free(idx);
+}
+
+static bool is_data_packet(uint16_t opcode)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		return true;
+	}
+
+	return false;
+}
+
+int pktindex_get_handle(uint16_t opcode, const void *data, uint16_t size)
+{
+	if (!is_data_packet(opcode) || size < 2)
+		return -1;
+
+	return get_le16(data) & 0x0fff;
+}
+
+static void print_handle(uint64_t key, void *value, void *user_data)
+{
+	struct pktindex_handle *entry = value;
+	FILE *fp = user_data;
+
+	fprintf(fp, "H %u %u %lu %lu %lu\n", entry->index, entry->handle,
+				entry->first, entry->last, entry->count);
+}
+
+static bool write_index(struct pktindex *idx, const char *path)
+{
+	unsigned int i;
+	FILE *fp;
+
+	fp = fopen(path, "we");
+	if (!fp)
+		return false;
+
+	fprintf(fp, "# btmon packet index\n");
+	fprintf(fp, "trace %llu %ld %ld\n", idx->trace.size, idx->trace.sec,
+							idx->trace.nsec);
+	fprintf(fp, "packets %lu\n", idx->packets);
+
+	for (i = 0; i < idx->num_buckets; i++)
+		fprintf(fp, "T %lu %lu\n",
+				(unsigned long) idx->buckets[i].sec,
+				idx->buckets[i].num);
+
+	hash_foreach(idx->handles, print_handle, fp);
+
+	if (fclose(fp))
+		return false;
+
+	return true;
+}
+
+static char *index_path(const char *path)
+{
+	char *str;
+
+	if (asprintf(&str, "%s.idx", path) < 0)
+		return NULL;
+
+	return str;
+}
+
+bool pktindex_build(const char *path)
+{
+	struct pktindex *idx;
+	struct map_file map;
+	struct timeval tv;
+	char *idx_path;
+	bool result = false;
+
+	if (!map_open(path, &map)) {
+		fprintf(stderr, "Indexing requires an uncompressed monitor "
+							"format trace\n");
+		return false;
+	}
+
+	idx = pktindex_new();
+	if (!idx)
+		goto done;
+
+	if (!get_trace(path, &idx->trace))
+		goto done;
+
+	while (1) {
+		uint16_t index, opcode, size;
+		unsigned long num = idx->packets;
+		const void *data;
+		int handle;
+
+		if (!map_read_hci(&map, &tv, &index, &opcode, &data, &size))
+			break;
+
+		idx->packets++;
+
+		if (!add_bucket(idx, tv.tv_sec, num))
+			goto done;
+
+		handle = pktindex_get_handle(opcode, data, size);
+		if (handle >= 0 && !add_handle(idx, index, handle, num))
+			goto done;
+	}
+
+	idx_path = index_path(path);
+	if (!idx_path)
+		goto done;
+
+	result = write_index(idx, idx_path);
+	if (result)
+		printf("Indexed %lu packets, %u handles into %s\n",
+				idx->packets, hash_count(idx->handles),
+				idx_path);
+	else
+		fprintf(stderr, "Failed to write %s\n", idx_path);
+
+	free(idx_path);
+
+done:
+	pktindex_free(idx);
+	map_close(&map);
+
+	return result;
+}
+
+/*
+ * The trace line comes first and the packets line before any T or H
+ * line, so every range can be checked against the packet count.
+ */
+static bool parse_line(struct pktindex *idx, const char *line,
+							bool *have_trace)
+{
+	unsigned long num, sec, first, last, count;
+	unsigned int index, handle;
+	struct pktindex_handle *entry;
+	struct pktindex_trace trace;
+
+	if (line[0] == '#')
+		return true;
+
+	if (sscanf(line, "trace %llu %ld %ld", &trace.size, &trace.sec,
+							&trace.nsec) == 3) {
+		*have_trace = true;
+		return trace.size == idx->trace.size &&
+					trace.sec == idx->trace.sec &&
+					trace.nsec == idx->trace.nsec;
+	}
+
+	if (!*have_trace)
+		return false;
+
+	if (sscanf(line, "packets %lu", &num) == 1) {
+		idx->packets = num;
+		return true;
+	}
+
+	if (sscanf(line, "T %lu %lu", &sec, &num) == 2)
+		return num < idx->packets && add_bucket(idx, sec, num);
+
+	if (sscanf(line, "H %u %u %lu %lu %lu", &index, &handle,
+					&first, &last, &count) == 5) {
+		if (index > UINT16_MAX || handle > UINT16_MAX ||
+				first > last || last >= idx->packets)
+			return false;
+
+		entry = get_handle(idx, index, handle);
+		if (!entry)
+			return false;
+
+		entry->first = first;
+		entry->last = last;
+		entry->count = count;
+		return true;
+	}
+
+	return false;
+}
+
+struct pktindex *pktindex_load(const char *path)
+{
+	struct pktindex *idx;
+	char *idx_path, line[256];
+	bool have_trace = false;
+	FILE *fp;
+
+	idx_path = index_path(path);
+	if (!idx_path)
+		return NULL;
+
+	fp = fopen(idx_path, "re");
+	if (!fp) {
+		free(idx_path);
+		return NULL;
+	}
+
+	idx = pktindex_new();
+	if (!idx)
+		goto failed;
+
+	if (!get_trace(path, &idx->trace))
+		goto failed;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (!parse_line(idx, line, &have_trace))
+			goto stale;
+	}
+
+	if (!have_trace)
+		goto stale;
+
+	fclose(fp);
+	free(idx_path);
+
+	return idx;
+
+stale:
+	fprintf(stderr, "Ignoring %s, it is stale or damaged. Rebuild it "
+						"with -x\n", idx_path);
+
+failed:
+	fclose(fp);
+	free(idx_path);
+	pktindex_free(idx);
+
+	return NULL;
+}
+
+struct range_data {
+	int index;
+	uint16_t handle;
+	unsigned int found;
+	struct pktindex_handle *entry;
+};
+
+static void match_handle(uint64_t key, void *value, void *user_data)
+{
+	struct pktindex_handle *entry = value;
+	struct range_data *range = user_data;
+
+	if (entry->handle != range->handle)
+		return;
+
+	if (range->index >= 0 && entry->index != range->index)
+		return;
+
+	range->entry = entry;
+	range->found++;
+}
+
+/*
+ * Looks up the packet range of a handle on the given controller, or on
+ * any controller when index is negative. Returns -ENOENT when the handle
+ * is not in the trace and -EEXIST when no controller was given and the
+ * handle is used on more than one.
+ */
+int pktindex_get_range(struct pktindex *idx, int *index, uint16_t handle,
+				unsigned long *first, unsigned long *last)
+{
+	struct range_data range = { .index = *index, .handle = handle };
+
+	hash_foreach(idx->handles, match_handle, &range);
+
+	if (!range.found)
+		return -ENOENT;
+
+	if (range.found > 1)
+		return -EEXIST;
+
+	*index = range.entry->index;
+	*first = range.entry->first;
+	*last = range.entry->last;
+
+	return 0;
+}
+
+/*
+ * Returns the number of the first packet captured at or after the
+ * second of the given time.
+ */
+unsigned long pktindex_find_time(struct pktindex *idx,
+					const struct timeval *tv)
+{
+	unsigned int lo = 0, hi = idx->num_buckets;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (idx->buckets[mid].sec < tv->tv_sec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == idx->num_buckets)
+		return idx->packets;
+
+	return idx->buckets[lo].num;
+}
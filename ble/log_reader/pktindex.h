@@ -0,0 +1,37 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+struct pktindex;
+
+bool pktindex_build(const char *path);
+
+struct pktindex *pktindex_load(const char *path);
+void pktindex_free(struct pktindex *idx);
+
+int pktindex_get_range(struct pktindex *idx, int *index, uint16_t handle,
+				unsigned long *first, unsigned long *last);
+unsigned long pktindex_find_time(struct pktindex *idx,
+					const struct timeval *tv);
+
+int pktindex_get_handle(uint16_t opcode, const void *data, uint16_t size);
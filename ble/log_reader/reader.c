@@ -0,0 +1,272 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "reader.h"
+
+/*
+ * Records are pulled from the btsnoop file on a background thread and
+ * handed to the decoder in batches. Decoding itself stays on the
+ * caller's thread and consumes batches strictly in file order, so the
+ * output is identical to reading the file inline while the read
+ * syscalls overlap with decoding.
+ */
+#define READER_BATCH_SIZE	256
+#define READER_MAX_QUEUE	8
+
+struct reader_record {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t size;
+	uint8_t data[BTSNOOP_MAX_PACKET_SIZE];
+};
+
+struct reader_batch {
+	struct reader_batch *next;
+	unsigned int count;
+	unsigned int pos;
+	struct reader_record records[READER_BATCH_SIZE];
+};
+
+struct reader {
+	struct btsnoop *btsnoop;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct reader_batch *queue_head;
+	struct reader_batch *queue_tail;
+	struct reader_batch *free_list;
+	struct reader_batch *current;
+	unsigned int queue_depth;
+	bool eof;
+	bool quit;
+};
+
+static struct reader_batch *get_batch(struct reader *reader)
+{
+	struct reader_batch *batch;
+
+	pthread_mutex_lock(&reader->lock);
+
+	while (reader->queue_depth >= READER_MAX_QUEUE && !reader->quit)
+		pthread_cond_wait(&reader->cond, &reader->lock);
+
+	if (reader->quit) {
+		pthread_mutex_unlock(&reader->lock);
+		return NULL;
+	}
+
+	batch = reader->free_list;
+	if (batch)
+		reader->free_list = batch->next;
+
+	pthread_mutex_unlock(&reader->lock);
+
+	if (!batch) {
+		batch = malloc(sizeof(*batch));
+		if (!batch)
+			return NULL;
+	}
+
+	batch->next = NULL;
+	batch->count = 0;
+	batch->pos = 0;
+
+	return batch;
+}
+
+static void put_batch(struct reader *reader, struct reader_batch *batch)
+{
+	pthread_mutex_lock(&reader->lock);
+
+	if (batch) {
+		if (reader->queue_tail)
+			reader->queue_tail->next = batch;
+		else
+			reader->queue_head = batch;
+		reader->queue_tail = batch;
+		reader->queue_depth++;
+	} else
+		reader->eof = true;
+
+	pthread_cond_broadcast(&reader->cond);
+	pthread_mutex_unlock(&reader->lock);
+}
+
+static void *reader_thread(void *user_data)
+{
+	struct reader *reader = user_data;
+	struct reader_batch *batch;
+	bool done = false;
+
+	while (!done) {
+		batch = get_batch(reader);
+		if (!batch)
+			break;
+
+		while (batch->count < READER_BATCH_SIZE) {
+			struct reader_record *rec = &batch->records[batch->count];
+
+			if (!btsnoop_read_hci(reader->btsnoop, &rec->tv,
+						&rec->index, &rec->opcode,
+						rec->data, &rec->size)) {
+				done = true;
+				break;
+			}
+
+			batch->count++;
+		}
+
+		if (!batch->count) {
+			free(batch);
+			break;
+		}
+
+		put_batch(reader, batch);
+	}
+
+	put_batch(reader, NULL);
+
+	return NULL;
+}
+
+struct reader *reader_new(struct btsnoop *btsnoop)
+{
+	struct reader *reader;
+
+	reader = new0(struct reader, 1);
+	if (!reader)
+		return NULL;
+
+	reader->btsnoop = btsnoop;
+
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->cond, NULL);
+
+	if (pthread_create(&reader->thread, NULL, reader_thread, reader)) {
+		pthread_cond_destroy(&reader->cond);
+		pthread_mutex_destroy(&reader->lock);
+		free(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+static void free_batches(struct reader_batch *batch)
+{
+	while (batch) {
+		struct reader_batch *next = batch->next;
+
+		free(batch);
+		batch = next;
+	}
+}
+
+void reader_free(struct reader *reader)
+{
+	if (!reader)
+		return;
+
+	pthread_mutex_lock(&reader->lock);
+	reader->quit = true;
+	pthread_cond_broadcast(&reader->cond);
+	pthread_mutex_unlock(&reader->lock);
+
+	pthread_join(reader->thread, NULL);
+
+	free_batches(reader->queue_head);
+	free_batches(reader->free_list);
+	free(reader->current);
+
+	pthread_cond_destroy(&reader->cond);
+	pthread_mutex_destroy(&reader->lock);
+
+	free(reader);
+}
+
+static struct reader_batch *next_batch(struct reader *reader)
+{
+	struct reader_batch *batch;
+
+	pthread_mutex_lock(&reader->lock);
+
+	if (reader->current) {
+		reader->current->next = reader->free_list;
+		reader->free_list = reader->current;
+		reader->current = NULL;
+	}
+
+	while (!reader->queue_head && !reader->eof)
+		pthread_cond_wait(&reader->cond, &reader->lock);
+
+	batch = reader->queue_head;
+	if (batch) {
+		reader->queue_head = batch->next;
+		if (!reader->queue_head)
+			reader->queue_tail = NULL;
+		reader->queue_depth--;
+		batch->next = NULL;
+	}
+
+	reader->current = batch;
+
+	pthread_cond_broadcast(&reader->cond);
+	pthread_mutex_unlock(&reader->lock);
+
+	return batch;
+}
+
+bool reader_next(struct reader *reader, struct timeval *tv, uint16_t *index,
+				uint16_t *opcode, const void **data,
+				uint16_t *size)
+{
+	struct reader_batch *batch = reader->current;
+	struct reader_record *rec;
+
+	if (!batch || batch->pos >= batch->count) {
+		batch = next_batch(reader);
+		if (!batch)
+			return false;
+	}
+
+	rec = &batch->records[batch->pos++];
+
+	*tv = rec->tv;
+	*index = rec->index;
+	*opcode = rec->opcode;
+	*data = rec->data;
+	*size = rec->size;
+
+	return true;
+}
@@ -0,0 +1,160 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ad.h"
+#include "record.h"
+
+#define RECORD_BUFFER_SIZE	(256 * 1024)
+
+/*
+ * Local little endian helpers, so that the writer also builds into the
+ * standalone log_reader without src/shared.
+ */
+static inline void record_put_le(uint64_t val, void *dst, unsigned int len)
+{
+	uint8_t *ptr = dst;
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		ptr[i] = val >> (i * 8);
+}
+
+static FILE *record_file = NULL;
+static char *record_buffer = NULL;
+static bool in_report = false;
+
+bool record_open(const char *path)
+{
+	uint8_t version[RECORD_VERSION_SIZE];
+
+	record_file = fopen(path, "we");
+	if (!record_file) {
+		perror("Failed to open record file");
+		return false;
+	}
+
+	record_buffer = malloc(RECORD_BUFFER_SIZE);
+	if (record_buffer)
+		setvbuf(record_file, record_buffer, _IOFBF,
+							RECORD_BUFFER_SIZE);
+
+	record_put_le(RECORD_VERSION, version, sizeof(version));
+
+	if (fwrite(RECORD_MAGIC, RECORD_MAGIC_LEN, 1, record_file) != 1 ||
+			fwrite(version, sizeof(version), 1, record_file) != 1) {
+		perror("Failed to write record file");
+		record_close();
+		return false;
+	}
+
+	return true;
+}
+
+void record_close(void)
+{
+	if (!record_file)
+		return;
+
+	fclose(record_file);
+	record_file = NULL;
+
+	free(record_buffer);
+	record_buffer = NULL;
+
+	in_report = false;
+}
+
+static void put_record(enum record_type type, const void *data1,
+			uint16_t len1, const void *data2, uint16_t len2)
+{
+	uint8_t hdr[RECORD_HDR_SIZE];
+
+	hdr[0] = type;
+	record_put_le(len1 + len2, hdr + 1, 2);
+
+	fwrite(hdr, sizeof(hdr), 1, record_file);
+	fwrite(data1, len1, 1, record_file);
+
+	if (len2)
+		fwrite(data2, len2, 1, record_file);
+}
+
+void record_report_begin(const struct timeval *tv)
+{
+	uint8_t ts[8];
+
+	if (!record_file)
+		return;
+
+	record_put_le(tv->tv_sec * 1000000ULL + tv->tv_usec, ts, sizeof(ts));
+	put_record(RECORD_REPORT, ts, sizeof(ts), NULL, 0);
+
+	in_report = true;
+}
+
+void record_report_end(void)
+{
+	in_report = false;
+}
+
+void record_u8(enum record_type type, uint8_t value)
+{
+	if (!in_report)
+		return;
+
+	put_record(type, &value, 1, NULL, 0);
+}
+
+void record_data(enum record_type type, const void *data, uint16_t len)
+{
+	if (!in_report)
+		return;
+
+	put_record(type, data, len, NULL, 0);
+}
+
+void record_ad(const struct ad_field *field)
+{
+	struct ad_uuid_list list;
+	struct ad_payload payload;
+	uint8_t i;
+
+	if (!in_report)
+		return;
+
+	put_record(RECORD_AD, &field->type, 1, field->data, field->len);
+
+	/* Pre-split the fields that the report tool indexes on */
+	if (ad_get_uuids(field, &list)) {
+		for (i = 0; i < list.count; i++)
+			put_record(RECORD_UUID, &field->type, 1,
+					list.data + i * list.size, list.size);
+	} else if (ad_get_manufacturer_data(field, &payload)) {
+		put_record(RECORD_COMPANY, field->data, 2, NULL, 0);
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+/*
+ * Advertising reports as a stream of typed records, so that tools like
+ * ble/report can consume decoded fields without parsing the text output.
+ *
+ * The stream starts with RECORD_MAGIC followed by the version as a 32-bit
+ * little endian value. Each record is a type octet, a 16-bit length and
+ * the payload, with all values in little endian. A RECORD_REPORT starts
+ * a new report and all records up to the next one belong to it.
+ */
+#define RECORD_MAGIC		"btmonrec"
+#define RECORD_MAGIC_LEN	8
+#define RECORD_VERSION		1
+#define RECORD_VERSION_SIZE	4
+#define RECORD_HDR_SIZE		3
+
+enum record_type {
+	RECORD_REPORT		= 0x01,	/* u64 timestamp in microseconds */
+	RECORD_EVENT_TYPE	= 0x02,	/* u8 */
+	RECORD_ADDRESS_TYPE	= 0x03,	/* u8 */
+	RECORD_ADDRESS		= 0x04,	/* 6 octets, as in the HCI event */
+	RECORD_RSSI		= 0x05,	/* s8 dBm */
+	RECORD_AD		= 0x06,	/* u8 AD type, AD data */
+	RECORD_COMPANY		= 0x07,	/* u16 company identifier */
+	RECORD_UUID		= 0x08,	/* u8 AD type, 2, 4 or 16 octets */
+};
+
+bool record_open(const char *path);
+void record_close(void);
+
+void record_report_begin(const struct timeval *tv);
+void record_report_end(void);
+
+void record_u8(enum record_type type, uint8_t value);
+void record_data(enum record_type type, const void *data, uint16_t len);
+struct ad_field;
+
+void record_ad(const struct ad_field *field);
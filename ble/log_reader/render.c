@@ -0,0 +1,450 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "display.h"
+#include "hex.h"
+#include "render.h"
+
+/*
+ * Rendering of hexdumps is fanned out to a pool of worker threads while
+ * the decoder keeps running. While the pipeline is active stdout is a
+ * stream that cuts the decoded text into chunks, and every hexdump
+ * becomes a chunk of its own that a worker fills in. A single emitter
+ * thread writes the chunks to the real output strictly in order, so the
+ * output is byte-identical to printing everything inline.
+ *
+ * A hexdump line is the row text wrapped in whatever print_text()
+ * prints around it. That prefix and suffix are taken from one line
+ * printed through print_text() when the pipeline starts.
+ *
+ * The decoders print through the display helpers, which always write
+ * to stdout, so stdout has to be the chunking stream. Only the main
+ * thread writes to that stream and only the emitter writes to the real
+ * output, but stdio locking is turned back on for the real output while
+ * the emitter owns it, since output.c turns it off.
+ */
+#define RENDER_MAX_CHUNKS	4096
+#define RENDER_STREAM_SIZE	(64 * 1024)
+#define RENDER_MARKER		"\x01"
+
+struct render_chunk {
+	struct render_chunk *next;
+	struct render_chunk *next_job;
+	char *text;
+	size_t len;
+	uint8_t *data;
+	uint16_t size;
+	bool done;
+};
+
+struct render {
+	FILE *output;
+	FILE *stream;
+	char *stream_buffer;
+	pthread_t workers[RENDER_MAX_JOBS];
+	unsigned int num_workers;
+	pthread_t emitter;
+	pthread_mutex_t lock;
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+	pthread_cond_t space_cond;
+	struct render_chunk *head;
+	struct render_chunk *tail;
+	struct render_chunk *job_head;
+	struct render_chunk *job_tail;
+	unsigned int num_chunks;
+	char *line;
+	size_t line_len;
+	size_t prefix_len;
+	bool template;
+	bool quit;
+};
+
+static struct render *render = NULL;
+
+static void push_chunk(struct render_chunk *chunk)
+{
+	pthread_mutex_lock(&render->lock);
+
+	while (render->num_chunks >= RENDER_MAX_CHUNKS)
+		pthread_cond_wait(&render->space_cond, &render->lock);
+
+	if (render->tail)
+		render->tail->next = chunk;
+	else
+		render->head = chunk;
+
+	render->tail = chunk;
+	render->num_chunks++;
+
+	if (chunk->data) {
+		if (render->job_tail)
+			render->job_tail->next_job = chunk;
+		else
+			render->job_head = chunk;
+
+		render->job_tail = chunk;
+		pthread_cond_signal(&render->job_cond);
+	} else
+		pthread_cond_signal(&render->done_cond);
+
+	pthread_mutex_unlock(&render->lock);
+}
+
+static ssize_t stream_write(void *cookie, const char *buf, size_t size)
+{
+	struct render_chunk *chunk;
+	char *text;
+
+	if (!size)
+		return 0;
+
+	text = malloc(size);
+	if (!text)
+		return -1;
+
+	memcpy(text, buf, size);
+
+	if (render->template) {
+		free(render->line);
+		render->line = text;
+		render->line_len = size;
+		return size;
+	}
+
+	chunk = calloc(1, sizeof(*chunk));
+	if (!chunk) {
+		free(text);
+		return -1;
+	}
+
+	chunk->text = text;
+	chunk->len = size;
+	chunk->done = true;
+
+	push_chunk(chunk);
+
+	return size;
+}
+
+static void render_chunk(struct render_chunk *chunk)
+{
+	size_t suffix_len = render->line_len - render->prefix_len - 1;
+	size_t row_len = render->prefix_len + HEX_ROW_SIZE - 1 + suffix_len;
+	char row[HEX_ROW_SIZE];
+	unsigned int i;
+	char *str;
+
+	chunk->text = malloc(((chunk->size + HEX_ROW_BYTES - 1) /
+					HEX_ROW_BYTES) * row_len);
+	if (!chunk->text)
+		return;
+
+	str = chunk->text;
+
+	for (i = 0; i < chunk->size; i += HEX_ROW_BYTES) {
+		hex_row(chunk->data + i, chunk->size - i, row);
+
+		memcpy(str, render->line, render->prefix_len);
+		str += render->prefix_len;
+		memcpy(str, row, HEX_ROW_SIZE - 1);
+		str += HEX_ROW_SIZE - 1;
+		memcpy(str, render->line + render->prefix_len + 1, suffix_len);
+		str += suffix_len;
+	}
+
+	chunk->len = str - chunk->text;
+}
+
+/*
+ * Fallback for a hexdump whose text buffer couldn't be allocated, the
+ * rows are formatted straight into the output instead.
+ */
+static void emit_rows(struct render_chunk *chunk)
+{
+	size_t suffix_len = render->line_len - render->prefix_len - 1;
+	char row[HEX_ROW_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < chunk->size; i += HEX_ROW_BYTES) {
+		hex_row(chunk->data + i, chunk->size - i, row);
+
+		fwrite(render->line, render->prefix_len, 1, render->output);
+		fwrite(row, HEX_ROW_SIZE - 1, 1, render->output);
+		fwrite(render->line + render->prefix_len + 1, suffix_len, 1,
+							render->output);
+	}
+}
+
+static void *worker_thread(void *user_data)
+{
+	struct render_chunk *chunk;
+
+	pthread_mutex_lock(&render->lock);
+
+	while (1) {
+		while (!render->job_head && !render->quit)
+			pthread_cond_wait(&render->job_cond, &render->lock);
+
+		chunk = render->job_head;
+		if (!chunk)
+			break;
+
+		render->job_head = chunk->next_job;
+		if (!render->job_head)
+			render->job_tail = NULL;
+
+		pthread_mutex_unlock(&render->lock);
+
+		render_chunk(chunk);
+
+		pthread_mutex_lock(&render->lock);
+
+		chunk->done = true;
+		if (chunk == render->head)
+			pthread_cond_signal(&render->done_cond);
+	}
+
+	pthread_mutex_unlock(&render->lock);
+
+	return NULL;
+}
+
+static void *emitter_thread(void *user_data)
+{
+	struct render_chunk *chunk;
+
+	pthread_mutex_lock(&render->lock);
+
+	while (1) {
+		while (!(render->head && render->head->done) &&
+				!(render->quit && !render->head))
+			pthread_cond_wait(&render->done_cond, &render->lock);
+
+		chunk = render->head;
+		if (!chunk)
+			break;
+
+		render->head = chunk->next;
+		if (!render->head)
+			render->tail = NULL;
+
+		render->num_chunks--;
+		pthread_cond_signal(&render->space_cond);
+
+		pthread_mutex_unlock(&render->lock);
+
+		if (chunk->text)
+			fwrite(chunk->text, chunk->len, 1, render->output);
+		else if (chunk->data)
+			emit_rows(chunk);
+
+		free(chunk->text);
+		free(chunk->data);
+		free(chunk);
+
+		pthread_mutex_lock(&render->lock);
+	}
+
+	pthread_mutex_unlock(&render->lock);
+
+	fflush(render->output);
+
+	return NULL;
+}
+
+static bool capture_template(void)
+{
+	char *marker;
+
+	fflush(stdout);
+
+	render->template = true;
+	print_text(COLOR_WHITE, "%s", RENDER_MARKER);
+	fflush(stdout);
+	render->template = false;
+
+	if (!render->line)
+		return false;
+
+	marker = memchr(render->line, RENDER_MARKER[0], render->line_len);
+	if (!marker)
+		return false;
+
+	render->prefix_len = marker - render->line;
+
+	return true;
+}
+
+static void free_render(void)
+{
+	if (render->stream)
+		fclose(render->stream);
+
+	pthread_mutex_destroy(&render->lock);
+	pthread_cond_destroy(&render->job_cond);
+	pthread_cond_destroy(&render->done_cond);
+	pthread_cond_destroy(&render->space_cond);
+
+	free(render->stream_buffer);
+	free(render->line);
+	free(render);
+	render = NULL;
+}
+
+static void join_threads(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&render->lock);
+	render->quit = true;
+	pthread_cond_broadcast(&render->job_cond);
+	pthread_cond_broadcast(&render->done_cond);
+	pthread_mutex_unlock(&render->lock);
+
+	for (i = 0; i < render->num_workers; i++)
+		pthread_join(render->workers[i], NULL);
+
+	pthread_join(render->emitter, NULL);
+}
+
+/*
+ * Decoder output is switched over to the pipeline until render_stop().
+ * If the pipeline can't be set up everything keeps printing inline.
+ */
+bool render_start(unsigned int jobs)
+{
+	cookie_io_functions_t funcs = { .write = stream_write };
+
+	if (render || !jobs)
+		return false;
+
+	if (jobs > RENDER_MAX_JOBS)
+		jobs = RENDER_MAX_JOBS;
+
+	render = calloc(1, sizeof(*render));
+	if (!render)
+		return false;
+
+	pthread_mutex_init(&render->lock, NULL);
+	pthread_cond_init(&render->job_cond, NULL);
+	pthread_cond_init(&render->done_cond, NULL);
+	pthread_cond_init(&render->space_cond, NULL);
+
+	render->stream_buffer = malloc(RENDER_STREAM_SIZE);
+	render->stream = fopencookie(render, "w", funcs);
+	if (!render->stream_buffer || !render->stream) {
+		free_render();
+		return false;
+	}
+
+	setvbuf(render->stream, render->stream_buffer, _IOFBF,
+							RENDER_STREAM_SIZE);
+
+	fflush(stdout);
+	render->output = stdout;
+	stdout = render->stream;
+
+	__fsetlocking(render->stream, FSETLOCKING_BYCALLER);
+	__fsetlocking(render->output, FSETLOCKING_INTERNAL);
+
+	if (!capture_template())
+		goto failed;
+
+	hex_init();
+
+	if (pthread_create(&render->emitter, NULL, emitter_thread, NULL))
+		goto failed;
+
+	for (; render->num_workers < jobs; render->num_workers++) {
+		if (pthread_create(&render->workers[render->num_workers],
+						NULL, worker_thread, NULL))
+			break;
+	}
+
+	if (!render->num_workers) {
+		join_threads();
+		goto failed;
+	}
+
+	return true;
+
+failed:
+	stdout = render->output;
+	__fsetlocking(stdout, FSETLOCKING_BYCALLER);
+	free_render();
+
+	return false;
+}
+
+void render_stop(void)
+{
+	if (!render)
+		return;
+
+	fflush(stdout);
+	stdout = render->output;
+
+	join_threads();
+
+	__fsetlocking(stdout, FSETLOCKING_BYCALLER);
+	free_render();
+}
+
+/*
+ * Queues a hexdump for the workers after the text printed so far.
+ * Returns false if the pipeline isn't running and the caller has to
+ * print it inline.
+ */
+bool render_hexdump(const void *data, uint16_t size)
+{
+	struct render_chunk *chunk;
+
+	if (!render)
+		return false;
+
+	chunk = calloc(1, sizeof(*chunk));
+	if (!chunk)
+		return false;
+
+	chunk->data = malloc(size);
+	if (!chunk->data) {
+		free(chunk);
+		return false;
+	}
+
+	memcpy(chunk->data, data, size);
+	chunk->size = size;
+
+	fflush(stdout);
+	push_chunk(chunk);
+
+	return true;
+}
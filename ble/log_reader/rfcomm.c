@@ -31,6 +31,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <sys/time.h>
 
 #include "lib/bluetooth.h"
 
@@ -38,6 +39,8 @@
 #include "bt.h"
 #include "packet.h"
 #include "display.h"
+#include "hash.h"
+#include "checkpoint.h"
 #include "l2cap.h"
 #include "uuid.h"
 #include "keys.h"
@@ -128,6 +131,340 @@ struct rfcomm_frame {
 	struct l2cap_frame l2cap_frame;
 };
 
+/*
+ * Per-DLCI link analytics. Everything is accounted by the direction that
+ * sends the frame, so credits[0] are the credits the local side may still
+ * spend and credits[1] the ones the remote side has left. Throughput is
+ * kept in time buckets; once RFCOMM_MAX_BUCKETS is exceeded neighbouring
+ * buckets are merged and the bucket width doubles.
+ */
+#define RFCOMM_BUCKET_USEC	1000000ULL
+#define RFCOMM_MAX_BUCKETS	64
+
+struct dlci_dir {
+	unsigned long frames;
+	uint64_t bytes;
+	uint64_t granted;
+	uint64_t consumed;
+	unsigned long overruns;
+	uint16_t credits;
+	bool credits_known;
+	bool starved;
+	struct timeval starve_start;
+	unsigned long starve_count;
+	uint64_t starve_total;
+	uint64_t starve_max;
+	uint64_t buckets[RFCOMM_MAX_BUCKETS];
+};
+
+struct dlci_data {
+	uint16_t index;
+	uint16_t handle;
+	uint8_t dlci;
+	uint16_t mtu;
+	bool cfc;
+	struct timeval start;
+	uint64_t width;
+	unsigned int num_buckets;
+	struct dlci_dir dir[2];
+};
+
+static struct hash *dlci_hash = NULL;
+
+static struct dlci_data *get_dlci(const struct l2cap_frame *frame,
+								uint8_t dlci)
+{
+	uint64_t key = ((uint64_t) frame->index << 32) |
+					((uint64_t) frame->handle << 16) | dlci;
+	struct dlci_data *data;
+
+	if (!dlci_hash) {
+		dlci_hash = hash_new();
+		if (!dlci_hash)
+			return NULL;
+	}
+
+	data = hash_lookup(dlci_hash, key);
+	if (data)
+		return data;
+
+	data = new0(struct dlci_data, 1);
+	if (!data)
+		return NULL;
+
+	data->index = frame->index;
+	data->handle = frame->handle;
+	data->dlci = dlci;
+	data->start = *packet_get_time();
+	data->width = RFCOMM_BUCKET_USEC;
+
+	if (!hash_insert(dlci_hash, key, data)) {
+		free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+static void merge_buckets(struct dlci_data *data)
+{
+	unsigned int i, d;
+
+	for (d = 0; d < 2; d++) {
+		uint64_t *buckets = data->dir[d].buckets;
+
+		for (i = 0; i < RFCOMM_MAX_BUCKETS / 2; i++)
+			buckets[i] = buckets[2 * i] + buckets[2 * i + 1];
+
+		memset(buckets + RFCOMM_MAX_BUCKETS / 2, 0,
+				sizeof(*buckets) * RFCOMM_MAX_BUCKETS / 2);
+	}
+
+	data->width *= 2;
+	data->num_buckets = (data->num_buckets + 1) / 2;
+}
+
+static void starve_begin(struct dlci_dir *dir)
+{
+	dir->starved = true;
+	dir->starve_start = *packet_get_time();
+}
+
+static void starve_end(struct dlci_dir *dir)
+{
+	uint64_t usec;
+
+	usec = packet_elapsed_usec(&dir->starve_start, packet_get_time());
+
+	dir->starved = false;
+	dir->starve_count++;
+	dir->starve_total += usec;
+
+	if (usec > dir->starve_max)
+		dir->starve_max = usec;
+}
+
+static void track_credits(struct dlci_dir *dir, uint8_t credits)
+{
+	dir->granted += credits;
+
+	if (!dir->credits_known)
+		return;
+
+	dir->credits += credits;
+
+	if (dir->starved && dir->credits)
+		starve_end(dir);
+}
+
+static void track_data(struct dlci_data *data, bool in, uint16_t len)
+{
+	struct dlci_dir *dir = &data->dir[in];
+	uint64_t bucket;
+
+	dir->frames++;
+	dir->bytes += len;
+
+	bucket = packet_elapsed_usec(&data->start, packet_get_time()) /
+								data->width;
+
+	while (bucket >= RFCOMM_MAX_BUCKETS) {
+		merge_buckets(data);
+		bucket /= 2;
+	}
+
+	dir->buckets[bucket] += len;
+
+	if (bucket >= data->num_buckets)
+		data->num_buckets = bucket + 1;
+
+	if (!data->cfc || !len)
+		return;
+
+	dir->consumed++;
+
+	if (!dir->credits_known)
+		return;
+
+	if (!dir->credits) {
+		dir->overruns++;
+		return;
+	}
+
+	if (!--dir->credits)
+		starve_begin(dir);
+}
+
+static void track_pn(const struct l2cap_frame *frame,
+					const struct rfcomm_pn *pn)
+{
+	struct dlci_data *data;
+	struct dlci_dir *dir;
+
+	data = get_dlci(frame, GET_PN_DLCI(pn->dlci));
+	if (!data)
+		return;
+
+	data->mtu = pn->mtu;
+
+	/* 0xf requests credit based flow control, 0xe accepts it */
+	switch (GET_CRT_FLOW(pn->flow_ctrl)) {
+	case 0x0f:
+	case 0x0e:
+		data->cfc = true;
+		break;
+	default:
+		data->cfc = false;
+		return;
+	}
+
+	/* Initial credits are granted to the receiver of the PN */
+	dir = &data->dir[!frame->in];
+	dir->granted += pn->credits;
+	dir->credits = pn->credits;
+	dir->credits_known = true;
+
+	if (dir->starved && dir->credits)
+		starve_end(dir);
+}
+
+static void print_throughput(const struct dlci_data *data)
+{
+	unsigned int i;
+	uint64_t secs;
+
+	if (!data->num_buckets)
+		return;
+
+	secs = data->width / 1000000ULL;
+
+	printf("    Throughput (%" PRIu64 " s buckets):\n", secs);
+
+	for (i = 0; i < data->num_buckets; i++)
+		printf("      %8" PRIu64 " s: TX %" PRIu64 " B/s RX %"
+				PRIu64 " B/s\n", i * secs,
+				data->dir[0].buckets[i] / secs,
+				data->dir[1].buckets[i] / secs);
+}
+
+static void print_dir(const char *label, const struct dlci_data *data,
+						const struct dlci_dir *dir)
+{
+	printf("    %s: %lu frames, %" PRIu64 " bytes\n", label,
+						dir->frames, dir->bytes);
+
+	if (!data->cfc)
+		return;
+
+	printf("      Credits: %" PRIu64 " granted, %" PRIu64 " consumed",
+						dir->granted, dir->consumed);
+
+	if (dir->credits_known)
+		printf(", %u left", dir->credits);
+
+	printf("\n");
+
+	if (dir->overruns)
+		printf("      Frames sent without credits: %lu\n",
+							dir->overruns);
+
+	if (dir->starve_count)
+		printf("      Starved: %lu times, total %" PRIu64
+				" us, avg %" PRIu64 " us, max %" PRIu64
+				" us\n", dir->starve_count, dir->starve_total,
+				dir->starve_total / dir->starve_count,
+				dir->starve_max);
+
+	if (dir->starved)
+		printf("      Starved at end of trace\n");
+}
+
+static void print_dlci(uint64_t key, void *value, void *user_data)
+{
+	struct dlci_data *data = value;
+
+	printf("  Connection: index %u handle %u dlci %u (channel %u)\n",
+				data->index, data->handle, data->dlci,
+				data->dlci >> 1);
+
+	if (data->mtu)
+		printf("    MTU: %u\n", data->mtu);
+
+	printf("    Flow control: %s\n", data->cfc ? "credit based" :
+								"none");
+
+	print_dir("TX", data, &data->dir[0]);
+	print_dir("RX", data, &data->dir[1]);
+
+	print_throughput(data);
+}
+
+void rfcomm_print_summary(void)
+{
+	if (!hash_count(dlci_hash))
+		return;
+
+	printf("\nRFCOMM summary\n");
+
+	hash_foreach(dlci_hash, print_dlci, NULL);
+
+	hash_destroy(dlci_hash, free);
+	dlci_hash = NULL;
+}
+
+static void save_dlci(uint64_t key, void *value, void *user_data)
+{
+	checkpoint_put(user_data, value, sizeof(struct dlci_data));
+}
+
+void rfcomm_save_state(struct checkpoint *ckpt)
+{
+	checkpoint_put_u32(ckpt, hash_count(dlci_hash));
+	hash_foreach(dlci_hash, save_dlci, ckpt);
+}
+
+bool rfcomm_restore_state(struct checkpoint *ckpt)
+{
+	struct dlci_data *data;
+	uint32_t i, count;
+	uint64_t key;
+
+	hash_destroy(dlci_hash, free);
+	dlci_hash = NULL;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	if (!count)
+		return true;
+
+	dlci_hash = hash_new();
+	if (!dlci_hash)
+		return false;
+
+	for (i = 0; i < count; i++) {
+		data = new0(struct dlci_data, 1);
+		if (!data)
+			return false;
+
+		if (!checkpoint_get(ckpt, data, sizeof(*data)) ||
+				data->num_buckets > RFCOMM_MAX_BUCKETS) {
+			free(data);
+			return false;
+		}
+
+		key = ((uint64_t) data->index << 32) |
+				((uint64_t) data->handle << 16) | data->dlci;
+
+		if (!hash_insert(dlci_hash, key, data)) {
+			free(data);
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static void print_rfcomm_hdr(struct rfcomm_frame *rfcomm_frame, uint8_t indent)
 {
 	struct rfcomm_lhdr hdr = rfcomm_frame->hdr;
@@ -297,6 +634,8 @@ static inline bool mcc_pn(struct rfcomm_frame *rfcomm_frame, uint8_t indent)
 			indent, ' ', pn.ack_timer, pn.mtu, pn.max_retrans,
 			pn.credits);
 
+	track_pn(frame, &pn);
+
 	return true;
 }
 
@@ -399,18 +738,30 @@ static bool uih_frame(struct rfcomm_frame *rfcomm_frame, uint8_t indent)
 	uint8_t credits;
 	struct l2cap_frame *frame = &rfcomm_frame->l2cap_frame;
 	struct rfcomm_lhdr *hdr = &rfcomm_frame->hdr;
+	struct dlci_data *data;
 
 	if (!RFCOMM_GET_CHANNEL(hdr->address))
 		return mcc_frame(rfcomm_frame, indent);
 
+	data = get_dlci(frame, RFCOMM_GET_DLCI(hdr->address));
+
 	/* fetching credits from UIH frame */
 	if (GET_PF(hdr->control)) {
 		if (!l2cap_frame_get_u8(frame, &credits))
 			return false;
 		hdr->credits = credits;
 		print_field("%*cCredits: %d", indent, ' ', hdr->credits);
+
+		/* Credits are granted to the peer of the sender */
+		if (data) {
+			data->cfc = true;
+			track_credits(&data->dir[!frame->in], credits);
+		}
 	}
 
+	if (data)
+		track_data(data, frame->in, hdr->length);
+
 	packet_hexdump(frame->data, frame->size);
 	return true;
 }
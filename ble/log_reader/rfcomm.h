@@ -78,3 +78,10 @@ struct rfcomm_pn {
 	uint8_t  max_retrans;
 	uint8_t  credits;
 } __attribute__((packed));
+
+void rfcomm_print_summary(void);
+
+struct checkpoint;
+
+void rfcomm_save_state(struct checkpoint *ckpt);
+bool rfcomm_restore_state(struct checkpoint *ckpt);
@@ -34,54 +34,167 @@
 #include "lib/bluetooth.h"
 
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 
 #include "bt.h"
 #include "packet.h"
 #include "display.h"
 #include "l2cap.h"
 #include "uuid.h"
+#include "hash.h"
+#include "checkpoint.h"
 #include "sdp.h"
 
-#define MAX_TID 16
+/*
+ * Continued responses are collected into one arena per transaction and
+ * only decoded once the final fragment arrived. Between a response and
+ * the follow-up request carrying its continuation state, the arena is
+ * parked on arena_list and picked up again by channel and token.
+ *
+ * Requests that are never answered and arenas whose follow-up request
+ * never comes are evicted oldest first once the limits are reached.
+ */
+#define MAX_ARENA_SIZE	(16 * 1024 * 1024)
+#define MAX_TID		64
+#define MAX_ARENA	8
+
+struct sdp_arena {
+	uint16_t channel;
+	uint8_t cont[17];
+	uint8_t *data;
+	uint32_t size;
+	uint32_t alloc;
+};
 
 struct tid_data {
-	bool inuse;
 	uint16_t tid;
 	uint16_t channel;
 	uint8_t cont[17];
+	struct sdp_arena *arena;
 };
 
-static struct tid_data tid_list[MAX_TID];
+static struct hash *tid_hash;
+static struct queue *tid_list;
+static struct queue *arena_list;
 
-static struct tid_data *get_tid(uint16_t tid, uint16_t channel)
+static inline uint64_t tid_key(uint16_t channel, uint16_t tid)
 {
-	int i, n = -1;
+	return (uint64_t) channel << 16 | tid;
+}
 
-	for (i = 0; i < MAX_TID; i++) {
-		if (!tid_list[i].inuse) {
-			if (n < 0)
-				n = i;
-			continue;
-		}
+static void arena_free(void *data)
+{
+	struct sdp_arena *arena = data;
+
+	if (!arena)
+		return;
+
+	free(arena->data);
+	free(arena);
+}
+
+static bool arena_append(struct sdp_arena *arena, const uint8_t *data,
+							uint32_t len)
+{
+	uint32_t alloc;
+	uint8_t *buf;
 
-		if (tid_list[i].tid == tid && tid_list[i].channel == channel)
-			return &tid_list[i];
+	if (len > MAX_ARENA_SIZE - arena->size)
+		return false;
+
+	if (arena->size + len > arena->alloc) {
+		alloc = arena->alloc ? arena->alloc : 256;
+
+		while (alloc < arena->size + len)
+			alloc *= 2;
+
+		buf = realloc(arena->data, alloc);
+		if (!buf)
+			return false;
+
+		arena->data = buf;
+		arena->alloc = alloc;
 	}
 
-	if (n < 0)
-		return NULL;
+	memcpy(arena->data + arena->size, data, len);
+	arena->size += len;
 
-	tid_list[n].inuse = true;
-	tid_list[n].tid = tid;
-	tid_list[n].channel = channel;
+	return true;
+}
+
+static bool match_arena(const void *data, const void *match_data)
+{
+	const struct sdp_arena *arena = data;
+	const struct tid_data *tid = match_data;
 
-	return &tid_list[n];
+	if (arena->channel != tid->channel)
+		return false;
+
+	return !memcmp(arena->cont, tid->cont, tid->cont[0] + 1);
+}
+
+static void tid_free(void *data)
+{
+	struct tid_data *tid = data;
+
+	arena_free(tid->arena);
+	free(tid);
 }
 
 static void clear_tid(struct tid_data *tid)
 {
-	if (tid)
-		tid->inuse = false;
+	if (!tid)
+		return;
+
+	hash_remove(tid_hash, tid_key(tid->channel, tid->tid));
+	queue_remove(tid_list, tid);
+	tid_free(tid);
+}
+
+static bool match_channel(const void *data, const void *match_data)
+{
+	const struct sdp_arena *arena = data;
+
+	return arena->channel == PTR_TO_UINT(match_data);
+}
+
+static struct tid_data *get_tid(uint16_t tid, uint16_t channel)
+{
+	struct tid_data *data;
+
+	if (!tid_hash) {
+		tid_hash = hash_new();
+		if (!tid_hash)
+			return NULL;
+
+		tid_list = queue_new();
+	}
+
+	data = hash_lookup(tid_hash, tid_key(channel, tid));
+	if (data)
+		return data;
+
+	data = new0(struct tid_data, 1);
+	if (!data)
+		return NULL;
+
+	data->tid = tid;
+	data->channel = channel;
+
+	if (!hash_insert(tid_hash, tid_key(channel, tid), data)) {
+		free(data);
+		return NULL;
+	}
+
+	if (!queue_push_tail(tid_list, data)) {
+		clear_tid(data);
+		return NULL;
+	}
+
+	if (queue_length(tid_list) > MAX_TID)
+		clear_tid(queue_peek_head(tid_list));
+
+	return data;
 }
 
 static void print_uint(uint8_t indent, const uint8_t *data, uint32_t size)
@@ -410,33 +523,36 @@ static void print_continuation(const uint8_t *data, uint16_t size)
 static void store_continuation(struct tid_data *tid,
 					const uint8_t *data, uint16_t size)
 {
-	memcpy(tid->cont, data, size);
-	print_continuation(data, size);
-}
+	arena_free(tid->arena);
+	tid->arena = NULL;
 
-#define MAX_CONT 8
+	if (size > 0 && size <= sizeof(tid->cont) && data[0] == size - 1) {
+		memcpy(tid->cont, data, size);
 
-struct cont_data {
-	uint16_t channel;
-	uint8_t cont[17];
-	void *data;
-	uint32_t size;
-};
+		if (tid->cont[0] > 0) {
+			tid->arena = queue_remove_if(arena_list, match_arena,
+									tid);
+		}
+	} else
+		tid->cont[0] = 0x00;
 
-static struct cont_data cont_list[MAX_CONT];
+	print_continuation(data, size);
+}
 
 static void handle_continuation(struct tid_data *tid, bool nested,
 			uint16_t bytes, const uint8_t *data, uint16_t size)
 {
-	uint8_t *newdata;
-	int i, n = -1;
+	struct sdp_arena *arena = tid->arena;
+	uint8_t len;
 
 	if (bytes + 1 > size) {
 		print_text(COLOR_ERROR, "missing continuation state");
 		return;
 	}
 
-	if (tid->cont[0] == 0x00 && data[bytes] == 0x00) {
+	len = data[bytes];
+
+	if (!arena && tid->cont[0] == 0x00 && len == 0x00) {
 		decode_data_elements(0, 2, data, bytes,
 				nested ? print_attr_lists : print_attr_list);
 
@@ -444,59 +560,63 @@ static void handle_continuation(struct tid_data *tid, bool nested,
 		return;
 	}
 
-	for (i = 0; i < MAX_CONT; i++) {
-		if (cont_list[i].cont[0] == 0x00) {
-			if (n < 0)
-				n = i;
-			continue;
-		}
+	print_continuation(data + bytes, size - bytes);
 
-		if (cont_list[i].channel != tid->channel)
-			continue;
+	tid->arena = NULL;
 
-		if (cont_list[i].cont[0] != tid->cont[0])
-			continue;
+	if (!arena) {
+		/* Continuation of a response that was never seen */
+		if (tid->cont[0] != 0x00) {
+			packet_hexdump(data, bytes);
+			return;
+		}
 
-		if (!memcmp(cont_list[i].cont + 1,
-					tid->cont + 1, tid->cont[0])) {
-			n = i;
-			break;
+		arena = new0(struct sdp_arena, 1);
+		if (!arena) {
+			print_text(COLOR_ERROR, "failed buffer allocation");
+			return;
 		}
+
+		arena->channel = tid->channel;
 	}
 
-	print_continuation(data + bytes, size - bytes);
+	if (!arena_append(arena, data, bytes)) {
+		print_text(COLOR_ERROR, "failed buffer allocation");
+		arena_free(arena);
+		return;
+	}
 
-	if (n < 0)
+	if (len == 0x00) {
+		print_field("Combined attribute bytes: %d", arena->size);
+
+		decode_data_elements(0, 2, arena->data, arena->size,
+				nested ? print_attr_lists : print_attr_list);
+
+		arena_free(arena);
 		return;
+	}
 
-	newdata = realloc(cont_list[n].data, cont_list[n].size + bytes);
-	if (!newdata) {
-		print_text(COLOR_ERROR, "failed buffer allocation");
-		free(cont_list[n].data);
-		cont_list[n].data = NULL;
-		cont_list[n].size = 0;
+	if (len >= sizeof(arena->cont) || len + 1 > size - bytes) {
+		arena_free(arena);
 		return;
 	}
 
-	cont_list[n].channel = tid->channel;
-	cont_list[n].data = newdata;
+	memcpy(arena->cont, data + bytes, len + 1);
 
-	if (bytes > 0) {
-		memcpy(cont_list[n].data + cont_list[n].size, data, bytes);
-		cont_list[n].size += bytes;
-	}
+	if (!arena_list)
+		arena_list = queue_new();
 
-	if (data[bytes] == 0x00) {
-		print_field("Combined attribute bytes: %d", cont_list[n].size);
+	/* A new response supersedes whatever the channel left parked */
+	queue_remove_all(arena_list, match_channel, UINT_TO_PTR(arena->channel),
+								arena_free);
 
-		decode_data_elements(0, 2, cont_list[n].data, cont_list[n].size,
-				nested ? print_attr_lists : print_attr_list);
+	if (!queue_push_tail(arena_list, arena)) {
+		arena_free(arena);
+		return;
+	}
 
-		free(cont_list[n].data);
-		cont_list[n].data = NULL;
-		cont_list[n].size = 0;
-	} else
-		memcpy(cont_list[i].cont, data + bytes, data[bytes] + 1);
+	if (queue_length(arena_list) > MAX_ARENA)
+		arena_free(queue_pop_head(arena_list));
 }
 
 static uint16_t common_rsp(const struct l2cap_frame *frame,
@@ -736,12 +856,160 @@ void sdp_packet(const struct l2cap_frame *frame)
 	print_indent(6, pdu_color, "SDP: ", pdu_str, COLOR_OFF,
 				" (0x%2.2x) tid %d len %d", pdu, tid, plen);
 
-	tid_info = get_tid(tid, frame->chan);
+	if (!sdp_data || !sdp_data->func) {
+		packet_hexdump(sdp_frame.data, sdp_frame.size);
+		return;
+	}
 
-	if (!sdp_data || !sdp_data->func || !tid_info) {
+	tid_info = get_tid(tid, frame->chan);
+	if (!tid_info) {
 		packet_hexdump(sdp_frame.data, sdp_frame.size);
 		return;
 	}
 
 	sdp_data->func(&sdp_frame, tid_info);
 }
+
+static void save_arena(struct checkpoint *ckpt,
+					const struct sdp_arena *arena)
+{
+	checkpoint_put(ckpt, &arena->channel, sizeof(arena->channel));
+	checkpoint_put(ckpt, arena->cont, sizeof(arena->cont));
+	checkpoint_put_u32(ckpt, arena->size);
+	checkpoint_put(ckpt, arena->data, arena->size);
+}
+
+static void save_pending(void *data, void *user_data)
+{
+	save_arena(user_data, data);
+}
+
+static void save_tid(void *value, void *user_data)
+{
+	struct tid_data *tid = value;
+	struct checkpoint *ckpt = user_data;
+	uint8_t has_arena = !!tid->arena;
+
+	checkpoint_put(ckpt, &tid->tid, sizeof(tid->tid));
+	checkpoint_put(ckpt, &tid->channel, sizeof(tid->channel));
+	checkpoint_put(ckpt, tid->cont, sizeof(tid->cont));
+	checkpoint_put(ckpt, &has_arena, sizeof(has_arena));
+
+	if (tid->arena)
+		save_arena(ckpt, tid->arena);
+}
+
+void sdp_save_state(struct checkpoint *ckpt)
+{
+	/* Saved oldest first so that eviction order survives a restore */
+	checkpoint_put_u32(ckpt, queue_length(tid_list));
+	queue_foreach(tid_list, save_tid, ckpt);
+
+	checkpoint_put_u32(ckpt, queue_length(arena_list));
+	queue_foreach(arena_list, save_pending, ckpt);
+}
+
+static struct sdp_arena *restore_arena(struct checkpoint *ckpt)
+{
+	struct sdp_arena *arena;
+	uint32_t size;
+
+	arena = new0(struct sdp_arena, 1);
+	if (!arena)
+		return NULL;
+
+	if (!checkpoint_get(ckpt, &arena->channel, sizeof(arena->channel)) ||
+			!checkpoint_get(ckpt, arena->cont,
+						sizeof(arena->cont)) ||
+			!checkpoint_get_u32(ckpt, &size) ||
+			size > MAX_ARENA_SIZE)
+		goto fail;
+
+	if (size) {
+		arena->data = malloc(size);
+		if (!arena->data)
+			goto fail;
+
+		if (!checkpoint_get(ckpt, arena->data, size))
+			goto fail;
+
+		arena->size = size;
+		arena->alloc = size;
+	}
+
+	return arena;
+
+fail:
+	arena_free(arena);
+	return NULL;
+}
+
+static bool restore_tid(struct checkpoint *ckpt)
+{
+	struct tid_data *data;
+	uint16_t tid, channel;
+	uint8_t has_arena;
+
+	if (!checkpoint_get(ckpt, &tid, sizeof(tid)) ||
+			!checkpoint_get(ckpt, &channel, sizeof(channel)))
+		return false;
+
+	data = get_tid(tid, channel);
+	if (!data)
+		return false;
+
+	if (!checkpoint_get(ckpt, data->cont, sizeof(data->cont)) ||
+			!checkpoint_get(ckpt, &has_arena, sizeof(has_arena)))
+		return false;
+
+	if (!has_arena)
+		return true;
+
+	data->arena = restore_arena(ckpt);
+
+	return data->arena != NULL;
+}
+
+bool sdp_restore_state(struct checkpoint *ckpt)
+{
+	struct sdp_arena *arena;
+	uint32_t i, count;
+
+	queue_destroy(tid_list, NULL);
+	tid_list = NULL;
+
+	hash_destroy(tid_hash, tid_free);
+	tid_hash = NULL;
+
+	queue_destroy(arena_list, arena_free);
+	arena_list = NULL;
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	for (i = 0; i < count; i++) {
+		if (!restore_tid(ckpt))
+			return false;
+	}
+
+	if (!checkpoint_get_u32(ckpt, &count))
+		return false;
+
+	if (!count)
+		return true;
+
+	arena_list = queue_new();
+
+	for (i = 0; i < count; i++) {
+		arena = restore_arena(ckpt);
+		if (!arena)
+			return false;
+
+		if (!queue_push_tail(arena_list, arena)) {
+			arena_free(arena);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -23,3 +23,8 @@
  */
 
 void sdp_packet(const struct l2cap_frame *frame);
+
+struct checkpoint;
+
+void sdp_save_state(struct checkpoint *ckpt);
+bool sdp_restore_state(struct checkpoint *ckpt);
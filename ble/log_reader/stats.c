@@ -0,0 +1,242 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "packet.h"
+#include "l2cap.h"
+#include "frag.h"
+#include "control.h"
+#include "output.h"
+#include "hash.h"
+#include "stats.h"
+
+enum stats_type {
+	STATS_HCI_COMMAND,
+	STATS_HCI_EVENT,
+	STATS_LE_META_EVENT,
+	STATS_L2CAP_CID,
+	STATS_L2CAP_PSM,
+	STATS_ATT_OPCODE,
+	STATS_TYPE_MAX,
+};
+
+static const struct {
+	const char *label;
+	const char *fmt;
+} stats_type_table[STATS_TYPE_MAX] = {
+	[STATS_HCI_COMMAND]	= { "HCI commands",	"0x%4.4" PRIx64 },
+	[STATS_HCI_EVENT]	= { "HCI events",	"0x%2.2" PRIx64 },
+	[STATS_LE_META_EVENT]	= { "LE meta events",	"0x%2.2" PRIx64 },
+	[STATS_L2CAP_CID]	= { "L2CAP CIDs",	"0x%4.4" PRIx64 },
+	[STATS_L2CAP_PSM]	= { "L2CAP PSMs",	"0x%4.4" PRIx64 },
+	[STATS_ATT_OPCODE]	= { "ATT opcodes",	"0x%2.2" PRIx64 },
+};
+
+struct stats_entry {
+	uint64_t key;
+	unsigned long count;
+};
+
+static struct hash *stats_hash = NULL;
+
+static void stats_add(enum stats_type type, uint32_t value)
+{
+	uint64_t key = ((uint64_t) type << 32) | value;
+	struct stats_entry *entry;
+
+	if (!stats_hash)
+		return;
+
+	entry = hash_lookup(stats_hash, key);
+	if (!entry) {
+		entry = new0(struct stats_entry, 1);
+		if (!entry)
+			return;
+
+		entry->key = key;
+
+		if (!hash_insert(stats_hash, key, entry)) {
+			free(entry);
+			return;
+		}
+	}
+
+	entry->count++;
+}
+
+void stats_hci(uint16_t opcode, const void *data, uint16_t size)
+{
+	const uint8_t *buf = data;
+
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		if (size < 2)
+			break;
+		stats_add(STATS_HCI_COMMAND, get_le16(buf));
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		if (size < 1)
+			break;
+		stats_add(STATS_HCI_EVENT, buf[0]);
+		/* LE Meta Event carries its subevent after the length */
+		if (buf[0] == 0x3e && size >= 3)
+			stats_add(STATS_LE_META_EVENT, buf[2]);
+		break;
+	}
+}
+
+void stats_l2cap(uint16_t cid, uint16_t psm)
+{
+	stats_add(STATS_L2CAP_CID, cid);
+
+	if (psm)
+		stats_add(STATS_L2CAP_PSM, psm);
+}
+
+void stats_att(uint8_t opcode)
+{
+	stats_add(STATS_ATT_OPCODE, opcode);
+}
+
+static void collect_entry(uint64_t key, void *value, void *user_data)
+{
+	struct stats_entry ***entry = user_data;
+
+	**entry = value;
+	(*entry)++;
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+	const struct stats_entry *entry1 = *(const struct stats_entry **) a;
+	const struct stats_entry *entry2 = *(const struct stats_entry **) b;
+
+	if (entry1->key < entry2->key)
+		return -1;
+
+	return entry1->key > entry2->key;
+}
+
+static void print_conn(struct packet_conn_data *conn, void *user_data)
+{
+	unsigned int *count = user_data;
+	struct timeval duration;
+
+	if (!(*count)++)
+		printf("Connections\n");
+
+	timersub(&conn->last_seen, &conn->first_seen, &duration);
+
+	printf("  hci%u handle %u: %" PRIu64 " packets (%" PRIu64 " in, %"
+			PRIu64 " out), %" PRIu64 " bytes, %lu.%06lu seconds\n",
+			conn->index, conn->handle,
+			conn->packets[1] + conn->packets[0],
+			conn->packets[1], conn->packets[0],
+			conn->bytes[1] + conn->bytes[0],
+			(unsigned long) duration.tv_sec,
+			(unsigned long) duration.tv_usec);
+}
+
+static void print_stats(void)
+{
+	struct stats_entry **list, **entry;
+	unsigned int i, count;
+	int type = -1;
+
+	count = hash_count(stats_hash);
+	if (!count)
+		return;
+
+	list = calloc(count, sizeof(*list));
+	if (!list)
+		return;
+
+	entry = list;
+	hash_foreach(stats_hash, collect_entry, &entry);
+
+	qsort(list, count, sizeof(*list), compare_entry);
+
+	for (i = 0; i < count; i++) {
+		if ((int) (list[i]->key >> 32) != type) {
+			type = list[i]->key >> 32;
+			printf("%s\n", stats_type_table[type].label);
+		}
+
+		printf("  ");
+		printf(stats_type_table[type].fmt,
+					list[i]->key & 0xffffffff);
+		printf(": %lu\n", list[i]->count);
+	}
+
+	free(list);
+}
+
+void stats_trace(const char *path)
+{
+	struct timeval start, end, elapsed;
+	unsigned long frag_allocs, frag_reuses;
+	unsigned int conn_count;
+
+	stats_hash = hash_new();
+	if (!stats_hash)
+		return;
+
+	/* Decoded text goes to /dev/null, only the counters are kept */
+	output_suspend();
+
+	gettimeofday(&start, NULL);
+	control_reader(path);
+	gettimeofday(&end, NULL);
+
+	output_resume();
+
+	timersub(&end, &start, &elapsed);
+
+	print_stats();
+
+	conn_count = 0;
+	packet_conn_foreach(print_conn, &conn_count);
+
+	frag_get_stats(&frag_allocs, &frag_reuses);
+	if (frag_allocs || frag_reuses)
+		printf("L2CAP fragment buffers: %lu allocated, %lu reused\n",
+						frag_allocs, frag_reuses);
+
+	printf("Decode time: %lu.%06lu seconds\n",
+				(unsigned long) elapsed.tv_sec,
+				(unsigned long) elapsed.tv_usec);
+
+	control_print_summary();
+
+	hash_destroy(stats_hash, free);
+	stats_hash = NULL;
+}
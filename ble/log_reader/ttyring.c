@@ -0,0 +1,291 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "tty.h"
+#include "ttyring.h"
+
+/*
+ * TTY input is collected in a power-of-two ring that can hold more
+ * than the largest possible frame, using free running head and tail
+ * counters. Frames are parsed in place and only copied out when they
+ * wrap around the end of the ring.
+ */
+#define TTY_RING_SIZE	(1 << 17)
+#define TTY_RING_MASK	(TTY_RING_SIZE - 1)
+#define TTY_MAX_FRAME	(2 + 0xffff)
+
+struct tty_ring {
+	uint8_t buf[TTY_RING_SIZE];
+	uint8_t frame[TTY_MAX_FRAME];
+	size_t head;
+	size_t tail;
+	bool resync;
+	struct tty_ring_stats *stats;
+	tty_ring_func_t func;
+	void *user_data;
+};
+
+static bool parse_drops(uint8_t **data, uint8_t *len, uint8_t *drops,
+							uint32_t *total)
+{
+	if (*len < 1)
+		return false;
+
+	*drops = **data;
+	*total += *drops;
+	(*data)++;
+	(*len)--;
+
+	return true;
+}
+
+static bool tty_parse_header(uint8_t *hdr, uint8_t len, struct timeval **tv,
+				struct timeval *ctv, uint32_t *drops)
+{
+	uint8_t cmd = 0;
+	uint8_t evt = 0;
+	uint8_t acl_tx = 0;
+	uint8_t acl_rx = 0;
+	uint8_t sco_tx = 0;
+	uint8_t sco_rx = 0;
+	uint8_t other = 0;
+	uint32_t total = 0;
+	uint32_t ts32;
+
+	while (len) {
+		uint8_t type = hdr[0];
+
+		hdr++; len--;
+
+		switch (type) {
+		case TTY_EXTHDR_COMMAND_DROPS:
+			if (!parse_drops(&hdr, &len, &cmd, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_EVENT_DROPS:
+			if (!parse_drops(&hdr, &len, &evt, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_ACL_TX_DROPS:
+			if (!parse_drops(&hdr, &len, &acl_tx, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_ACL_RX_DROPS:
+			if (!parse_drops(&hdr, &len, &acl_rx, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_SCO_TX_DROPS:
+			if (!parse_drops(&hdr, &len, &sco_tx, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_SCO_RX_DROPS:
+			if (!parse_drops(&hdr, &len, &sco_rx, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_OTHER_DROPS:
+			if (!parse_drops(&hdr, &len, &other, &total))
+				return false;
+			break;
+		case TTY_EXTHDR_TS32:
+			if (len < sizeof(ts32))
+				return false;
+			ts32 = get_le32(hdr);
+			hdr += sizeof(ts32); len -= sizeof(ts32);
+			/* ts32 is in units of 1/10th of a millisecond */
+			ctv->tv_sec = ts32 / 10000;
+			ctv->tv_usec = (ts32 % 10000) * 100;
+			*tv = ctv;
+			break;
+		default:
+			printf("Unknown extended header type %u\n", type);
+			return false;
+		}
+	}
+
+	if (total) {
+		*drops += total;
+		printf("* Drops: cmd %u evt %u acl_tx %u acl_rx %u sco_tx %u "
+			"sco_rx %u other %u\n", cmd, evt, acl_tx, acl_rx,
+			sco_tx, sco_rx, other);
+	}
+
+	return true;
+}
+
+static inline uint8_t ring_byte(struct tty_ring *ring, size_t offset)
+{
+	return ring->buf[(ring->head + offset) & TTY_RING_MASK];
+}
+
+static inline uint16_t ring_le16(struct tty_ring *ring, size_t offset)
+{
+	return ring_byte(ring, offset) | (ring_byte(ring, offset + 1) << 8);
+}
+
+static const uint8_t *ring_frame(struct tty_ring *ring, size_t len)
+{
+	size_t pos = ring->head & TTY_RING_MASK;
+	size_t first = TTY_RING_SIZE - pos;
+
+	if (len <= first)
+		return ring->buf + pos;
+
+	memcpy(ring->frame, ring->buf + pos, first);
+	memcpy(ring->frame + first, ring->buf, len - first);
+
+	return ring->frame;
+}
+
+static void tty_resync(struct tty_ring *ring)
+{
+	if (!ring->resync) {
+		fprintf(stderr, "Received corrupted data from TTY, "
+							"resyncing\n");
+		ring->resync = true;
+		ring->stats->resyncs++;
+	}
+
+	ring->stats->skipped++;
+	ring->head++;
+}
+
+static void tty_process(struct tty_ring *ring)
+{
+	while (ring->tail - ring->head >= sizeof(struct tty_hdr)) {
+		const struct tty_hdr *hdr;
+		uint16_t pktlen, opcode, data_len;
+		struct timeval *tv = NULL;
+		struct timeval ctv;
+		uint32_t drops = 0;
+		uint8_t hdr_len;
+
+		data_len = ring_le16(ring, 0);
+		hdr_len = ring_byte(ring, 5);
+
+		/* Skip bytes until the length fields are consistent again */
+		if (data_len < 4 + hdr_len ||
+				data_len - 4 - hdr_len > BTSNOOP_MAX_PACKET_SIZE) {
+			tty_resync(ring);
+			continue;
+		}
+
+		if (ring->tail - ring->head < 2 + (size_t) data_len)
+			return;
+
+		hdr = (const struct tty_hdr *) ring_frame(ring, 2 + data_len);
+
+		if (!tty_parse_header((uint8_t *) hdr->ext_hdr, hdr->hdr_len,
+							&tv, &ctv, &drops)) {
+			fprintf(stderr, "Unable to parse extended header\n");
+			tty_resync(ring);
+			continue;
+		}
+
+		ring->resync = false;
+
+		opcode = le16_to_cpu(hdr->opcode);
+		pktlen = data_len - 4 - hdr->hdr_len;
+
+		ring->stats->frames++;
+		ring->stats->drops += drops;
+
+		ring->func(tv, opcode, drops, hdr->ext_hdr + hdr->hdr_len,
+						pktlen, ring->user_data);
+
+		ring->head += 2 + data_len;
+	}
+}
+
+struct tty_ring *tty_ring_new(struct tty_ring_stats *stats,
+				tty_ring_func_t func, void *user_data)
+{
+	struct tty_ring *ring;
+
+	ring = malloc(sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->resync = false;
+	ring->stats = stats;
+	ring->func = func;
+	ring->user_data = user_data;
+
+	return ring;
+}
+
+void tty_ring_free(struct tty_ring *ring)
+{
+	free(ring);
+}
+
+/* Drain the TTY with as few and as large reads as possible */
+void tty_ring_drain(struct tty_ring *ring, int fd)
+{
+	while (1) {
+		size_t pos = ring->tail & TTY_RING_MASK;
+		size_t space = TTY_RING_SIZE - (ring->tail - ring->head);
+		struct iovec iov[2];
+		int iovcnt = 1;
+		ssize_t len;
+
+		if (!space)
+			break;
+
+		iov[0].iov_base = ring->buf + pos;
+		iov[0].iov_len = TTY_RING_SIZE - pos;
+
+		if (iov[0].iov_len >= space)
+			iov[0].iov_len = space;
+		else {
+			iov[1].iov_base = ring->buf;
+			iov[1].iov_len = space - iov[0].iov_len;
+			iovcnt = 2;
+		}
+
+		len = readv(fd, iov, iovcnt);
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len <= 0)
+			break;
+
+		ring->stats->reads++;
+		ring->stats->bytes += len;
+
+		ring->tail += len;
+
+		tty_process(ring);
+	}
+}
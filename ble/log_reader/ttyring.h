@@ -0,0 +1,44 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+struct tty_ring;
+
+struct tty_ring_stats {
+	unsigned long reads;
+	uint64_t bytes;
+	unsigned long frames;
+	unsigned long drops;
+	unsigned long resyncs;
+	unsigned long skipped;
+};
+
+typedef void (*tty_ring_func_t)(struct timeval *tv, uint16_t opcode,
+					uint32_t drops, const void *data,
+					uint16_t size, void *user_data);
+
+struct tty_ring *tty_ring_new(struct tty_ring_stats *stats,
+				tty_ring_func_t func, void *user_data);
+void tty_ring_free(struct tty_ring *ring);
+
+void tty_ring_drain(struct tty_ring *ring, int fd);
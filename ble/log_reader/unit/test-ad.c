@@ -0,0 +1,214 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ad.h"
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		printf("%s:%d: %s\n", __func__, __LINE__, #cond);	\
+		return 1;						\
+	}								\
+} while (0)
+
+static const uint8_t adv_data[] = {
+	0x02, AD_TYPE_FLAGS, 0x06,
+	0x05, AD_TYPE_UUID16_ALL, 0x0f, 0x18, 0x0a, 0x18,
+	0x05, AD_TYPE_NAME_COMPLETE, 'T', 'e', 's', 't',
+	0x02, AD_TYPE_TX_POWER, 0xf4,
+	0x05, AD_TYPE_SERVICE_DATA16, 0x0f, 0x18, 0x55, 0x01,
+	0x05, AD_TYPE_MANUFACTURER_DATA, 0x4c, 0x00, 0x02, 0x15,
+};
+
+static int test_iter(void)
+{
+	static const uint8_t types[] = {
+		AD_TYPE_FLAGS, AD_TYPE_UUID16_ALL, AD_TYPE_NAME_COMPLETE,
+		AD_TYPE_TX_POWER, AD_TYPE_SERVICE_DATA16,
+		AD_TYPE_MANUFACTURER_DATA,
+	};
+	struct ad_iter iter;
+	struct ad_field field;
+	unsigned int count = 0;
+
+	ad_iter_init(&iter, adv_data, sizeof(adv_data));
+
+	while (ad_iter_next(&iter, &field)) {
+		CHECK(count < sizeof(types));
+		CHECK(field.type == types[count]);
+		CHECK(field.data >= adv_data);
+		CHECK(field.data + field.len <= adv_data + sizeof(adv_data));
+		count++;
+	}
+
+	CHECK(count == sizeof(types));
+	CHECK(ad_iter_trailing(&iter, NULL) == 0);
+
+	return 0;
+}
+
+static int test_accessors(void)
+{
+	struct ad_field field;
+	struct ad_uuid_list list;
+	struct ad_payload payload;
+	const char *name;
+	uint8_t flags, len;
+	int8_t power;
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_FLAGS, &field));
+	CHECK(ad_get_flags(&field, &flags) && flags == 0x06);
+	CHECK(!ad_get_tx_power(&field, &power));
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_UUID16_ALL, &field));
+	CHECK(ad_get_uuids(&field, &list));
+	CHECK(list.size == 2 && list.count == 2);
+	CHECK(list.data[0] == 0x0f && list.data[2] == 0x0a);
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_NAME_COMPLETE,
+								&field));
+	CHECK(ad_get_name(&field, &name, &len));
+	CHECK(len == 4 && !memcmp(name, "Test", 4));
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_TX_POWER, &field));
+	CHECK(ad_get_tx_power(&field, &power) && power == -12);
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_SERVICE_DATA16,
+								&field));
+	CHECK(!ad_get_uuids(&field, &list));
+	CHECK(ad_get_service_data(&field, &payload));
+	CHECK(payload.uuid_size == 2 && payload.id == 0x180f);
+	CHECK(payload.len == 2 && payload.data[0] == 0x55);
+
+	CHECK(ad_find(adv_data, sizeof(adv_data), AD_TYPE_MANUFACTURER_DATA,
+								&field));
+	CHECK(ad_get_manufacturer_data(&field, &payload));
+	CHECK(payload.id == 0x004c && !payload.uuid);
+	CHECK(payload.len == 2 && payload.data[0] == 0x02);
+
+	CHECK(!ad_find(adv_data, sizeof(adv_data), AD_TYPE_NAME_SHORT,
+								&field));
+
+	return 0;
+}
+
+static int test_malformed(void)
+{
+	/* Second structure claims more than is left */
+	static const uint8_t overrun[] = {
+		0x02, AD_TYPE_FLAGS, 0x06, 0x09, AD_TYPE_NAME_COMPLETE, 'x',
+	};
+	/* Zero padding after the last structure */
+	static const uint8_t padded[] = {
+		0x02, AD_TYPE_FLAGS, 0x06, 0x00, 0x00, 0x00,
+	};
+	/* Too short to be used by the accessors */
+	static const uint8_t short_fields[] = {
+		0x01, AD_TYPE_FLAGS, 0x02, AD_TYPE_UUID128_ALL, 0x00,
+		0x02, AD_TYPE_MANUFACTURER_DATA, 0x4c,
+	};
+	struct ad_iter iter;
+	struct ad_field field;
+	struct ad_uuid_list list;
+	struct ad_payload payload;
+	const uint8_t *rest;
+	uint8_t flags;
+
+	ad_iter_init(&iter, overrun, sizeof(overrun));
+	CHECK(ad_iter_next(&iter, &field));
+	CHECK(!ad_iter_next(&iter, &field));
+	CHECK(ad_iter_trailing(&iter, &rest) == 3);
+	CHECK(rest == overrun + 3);
+
+	ad_iter_init(&iter, padded, sizeof(padded));
+	CHECK(ad_iter_next(&iter, &field));
+	CHECK(!ad_iter_next(&iter, &field));
+	CHECK(ad_iter_trailing(&iter, NULL) == 0);
+
+	ad_iter_init(&iter, short_fields, sizeof(short_fields));
+	CHECK(ad_iter_next(&iter, &field));
+	CHECK(!ad_get_flags(&field, &flags));
+	CHECK(ad_iter_next(&iter, &field));
+	CHECK(!ad_get_uuids(&field, &list));
+	CHECK(ad_iter_next(&iter, &field));
+	CHECK(!ad_get_manufacturer_data(&field, &payload));
+	CHECK(!ad_iter_next(&iter, &field));
+
+	ad_iter_init(&iter, adv_data, 0);
+	CHECK(!ad_iter_next(&iter, &field));
+	CHECK(ad_iter_trailing(&iter, NULL) == 0);
+
+	return 0;
+}
+
+/* Walks random data and checks every field stays inside the buffer */
+static int test_random(void)
+{
+	uint8_t buf[255];
+	struct ad_iter iter;
+	struct ad_field field;
+	unsigned int round, i, len, used;
+
+	for (round = 0; round < 200000; round++) {
+		len = rand() % (sizeof(buf) + 1);
+
+		for (i = 0; i < len; i++)
+			buf[i] = rand() % 4 ? rand() % 32 : rand();
+
+		ad_iter_init(&iter, buf, len);
+		used = 0;
+
+		while (ad_iter_next(&iter, &field)) {
+			CHECK(field.data == buf + used + 2);
+			CHECK(used + 2 + field.len <= len);
+			used += field.len + 2;
+		}
+
+		CHECK(iter.offset == used);
+		CHECK(ad_iter_trailing(&iter, NULL) == 0 ||
+				ad_iter_trailing(&iter, NULL) == len - used);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	srand(1);
+
+	err |= test_iter();
+	err |= test_accessors();
+	err |= test_malformed();
+	err |= test_random();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
@@ -0,0 +1,116 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc24.h"
+
+/* Bitwise CRC24 as in crc24_calculate() */
+static uint32_t ref_crc24(uint32_t preset, const uint8_t *data,
+							unsigned int len)
+{
+	uint32_t state = preset;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		uint8_t n, cur = data[i];
+
+		for (n = 0; n < 8; n++) {
+			int next_bit = (state ^ cur) & 1;
+
+			cur >>= 1;
+			state >>= 1;
+
+			if (next_bit) {
+				state |= 1 << 23;
+				state ^= 0x5a6000;
+			}
+		}
+	}
+
+	return state;
+}
+
+static int test_crc24(void)
+{
+	uint8_t buf[258];
+	uint32_t preset, ref, crc;
+	unsigned int len, round;
+
+	for (round = 0; round < 2000; round++) {
+		for (len = 0; len < sizeof(buf); len++)
+			buf[len] = rand();
+
+		preset = rand() & 0xffffff;
+
+		for (len = 0; len <= sizeof(buf); len++) {
+			ref = ref_crc24(preset, buf, len);
+			crc = crc24_table_calculate(preset, buf, len);
+
+			if (ref != crc) {
+				printf("crc24: 0x%6.6x != 0x%6.6x at %u bytes\n",
+							crc, ref, len);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Every single byte value from the advertising channel preset */
+static int test_crc24_bytes(void)
+{
+	unsigned int i;
+	uint8_t byte;
+
+	for (i = 0; i < 256; i++) {
+		byte = i;
+
+		if (ref_crc24(0x555555, &byte, 1) !=
+				crc24_table_calculate(0x555555, &byte, 1)) {
+			printf("crc24: mismatch for byte 0x%2.2x\n", i);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	srand(1);
+
+	err |= test_crc24_bytes();
+	err |= test_crc24();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
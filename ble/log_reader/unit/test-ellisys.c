@@ -0,0 +1,257 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "src/shared/btsnoop.h"
+#include "packet.h"
+#include "ellisys.h"
+
+/*
+ * Replays packets into a local UDP listener with the blocking policy
+ * and checks that every datagram arrives intact and in order. Datagrams
+ * the kernel drops on a full receive buffer are reported through
+ * SO_RXQ_OVFL and counted, anything else missing was lost in the
+ * injection queue.
+ */
+
+#define NUM_PACKETS	20000
+#define HDR_SIZE	22
+
+struct listener {
+	int fd;
+	unsigned int received;
+	unsigned int next;
+	uint32_t kernel_drops;
+	int err;
+};
+
+/* Provided by packet.c in the full build */
+const struct tm *packet_local_time(time_t sec)
+{
+	static struct tm tm;
+
+	localtime_r(&sec, &tm);
+
+	return &tm;
+}
+
+static uint16_t packet_size(unsigned int seq)
+{
+	return 4 + (seq * 7) % (BTSNOOP_MAX_PACKET_SIZE - 4);
+}
+
+static void fill_packet(unsigned int seq, uint8_t *buf, uint16_t size)
+{
+	uint16_t i;
+
+	memcpy(buf, &seq, 4);
+
+	for (i = 4; i < size; i++)
+		buf[i] = seq + i;
+}
+
+static int check_datagram(struct listener *l, const uint8_t *buf,
+								ssize_t len)
+{
+	uint8_t expect[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned int seq;
+	uint16_t size;
+
+	if (len < HDR_SIZE + 4 || buf[0] != 0x02 || buf[2] != 0x01 ||
+							buf[21] != 0x82) {
+		printf("ellisys: malformed datagram\n");
+		return 1;
+	}
+
+	memcpy(&seq, buf + HDR_SIZE, 4);
+
+	/* Kernel drops may open gaps, but order must be kept */
+	if (seq < l->next) {
+		printf("ellisys: packet %u after %u\n", seq, l->next);
+		return 1;
+	}
+
+	size = packet_size(seq);
+	fill_packet(seq, expect, size);
+
+	if (len != HDR_SIZE + size || memcmp(buf + HDR_SIZE, expect, size) ||
+				buf[20] != (seq % 2 ? 0x82 : 0x02)) {
+		printf("ellisys: packet %u corrupted\n", seq);
+		return 1;
+	}
+
+	l->next = seq + 1;
+
+	return 0;
+}
+
+static void *listener_func(void *user_data)
+{
+	struct listener *l = user_data;
+	uint8_t buf[HDR_SIZE + BTSNOOP_MAX_PACKET_SIZE + 1];
+	char control[CMSG_SPACE(sizeof(uint32_t))];
+	struct iovec iov = { buf, sizeof(buf) };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t len;
+
+	while (l->next < NUM_PACKETS) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		len = recvmsg(l->fd, &msg, 0);
+		if (len < 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+					cmsg->cmsg_type == SO_RXQ_OVFL)
+				memcpy(&l->kernel_drops, CMSG_DATA(cmsg),
+							sizeof(uint32_t));
+		}
+
+		l->received++;
+
+		if (check_datagram(l, buf, len)) {
+			l->err = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int open_listener(uint16_t *port)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int fd, val = 4 * 1024 * 1024;
+	struct timeval timeout = { 2, 0 };
+
+	fd = socket(PF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+			getsockname(fd, (struct sockaddr *) &addr,
+							&addr_len) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val));
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	val = 1;
+	setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &val, sizeof(val));
+
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+static int test_replay(void)
+{
+	struct listener l;
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	pthread_t thread;
+	unsigned int seq;
+	uint16_t port, size;
+
+	memset(&l, 0, sizeof(l));
+
+	l.fd = open_listener(&port);
+	if (l.fd < 0) {
+		perror("ellisys: failed to open listener");
+		return 1;
+	}
+
+	if (pthread_create(&thread, NULL, listener_func, &l)) {
+		close(l.fd);
+		return 1;
+	}
+
+	ellisys_enable("127.0.0.1", port, ELLISYS_BLOCK);
+
+	gettimeofday(&tv, NULL);
+
+	for (seq = 0; seq < NUM_PACKETS; seq++) {
+		size = packet_size(seq);
+		fill_packet(seq, buf, size);
+
+		ellisys_inject_hci(&tv, 0, seq % 2 ?
+					BTSNOOP_OPCODE_ACL_RX_PKT :
+					BTSNOOP_OPCODE_ACL_TX_PKT, buf, size);
+	}
+
+	ellisys_disable();
+
+	pthread_join(thread, NULL);
+	close(l.fd);
+
+	if (l.err)
+		return 1;
+
+	if (l.received + l.kernel_drops != NUM_PACKETS) {
+		printf("ellisys: %u received, %u dropped by the kernel, "
+				"%u sent\n", l.received, l.kernel_drops,
+				NUM_PACKETS);
+		return 1;
+	}
+
+	ellisys_print_stats();
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	err |= test_replay();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
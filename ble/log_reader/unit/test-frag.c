@@ -0,0 +1,191 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frag.h"
+
+/*
+ * Reassembles PDUs through the fragment helpers used by l2cap.c and
+ * checks the size classes, buffer reuse and the free list depth of the
+ * pool behind them. The pool counters are global, so each test works on
+ * differences.
+ */
+
+#define NUM_FRAGS	20
+
+static int test_reassembly(void)
+{
+	struct frag_data frag;
+	uint8_t pdu[300], chunk[27];
+	uint16_t size;
+	unsigned int i;
+
+	memset(&frag, 0, sizeof(frag));
+
+	for (i = 0; i < sizeof(pdu); i++)
+		pdu[i] = rand();
+
+	if (!frag_start(&frag, 0x0040, sizeof(pdu)) || frag.cid != 0x0040)
+		return 1;
+
+	for (i = 0; frag.len; i += size) {
+		size = frag.len < sizeof(chunk) ? frag.len : sizeof(chunk);
+
+		memcpy(chunk, pdu + i, size);
+
+		if (!frag_append(&frag, chunk, size))
+			return 1;
+
+		/* The caller's buffer is reused for the next fragment */
+		memset(chunk, 0, sizeof(chunk));
+	}
+
+	if (frag.pos != sizeof(pdu) || memcmp(frag.buf, pdu, sizeof(pdu))) {
+		printf("frag: reassembled PDU differs\n");
+		return 1;
+	}
+
+	/* A fragment beyond the announced length is rejected as a whole */
+	if (frag_append(&frag, chunk, 1) || frag.pos != sizeof(pdu))
+		return 1;
+
+	frag_clear(&frag);
+
+	if (frag.buf || frag.pos || frag.len)
+		return 1;
+
+	return 0;
+}
+
+static int test_classes(void)
+{
+	static const struct {
+		uint32_t len;
+		uint8_t buf_class;
+	} sizes[] = {
+		{ 1, 0 }, { 64, 0 }, { 65, 1 }, { 1024, 2 }, { 1025, 3 },
+		{ 16384, 4 }, { 65535, 5 },
+	};
+	struct frag_data frag;
+	unsigned int i;
+
+	memset(&frag, 0, sizeof(frag));
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (!frag_start(&frag, 0x0004, sizes[i].len))
+			return 1;
+
+		if (frag.buf_class != sizes[i].buf_class) {
+			printf("frag: %u bytes in class %u\n", sizes[i].len,
+							frag.buf_class);
+			return 1;
+		}
+
+		/* The buffer holds at least the requested length */
+		memset(frag.buf, 0xaa, sizes[i].len);
+
+		frag_clear(&frag);
+	}
+
+	if (frag_start(&frag, 0x0004, 65536)) {
+		printf("frag: PDU beyond 64 KiB accepted\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static int test_reuse(void)
+{
+	struct frag_data frag[NUM_FRAGS];
+	unsigned long allocs, reuses, base_allocs, base_reuses;
+	void *buf;
+	unsigned int i;
+
+	memset(frag, 0, sizeof(frag));
+
+	if (!frag_start(&frag[0], 0x0040, 200))
+		return 1;
+
+	buf = frag[0].buf;
+	frag_clear(&frag[0]);
+
+	frag_get_stats(&base_allocs, &base_reuses);
+
+	/* A finished buffer serves the next PDU of the same class */
+	if (!frag_start(&frag[0], 0x0040, 150) || frag[0].buf != buf)
+		return 1;
+
+	frag_clear(&frag[0]);
+
+	frag_get_stats(&allocs, &reuses);
+
+	if (allocs != base_allocs || reuses != base_reuses + 1) {
+		printf("frag: buffer was not reused\n");
+		return 1;
+	}
+
+	/* Only so many buffers per class are kept around */
+	for (i = 0; i < NUM_FRAGS; i++) {
+		if (!frag_start(&frag[i], 0x0040, 4000))
+			return 1;
+	}
+
+	for (i = 0; i < NUM_FRAGS; i++)
+		frag_clear(&frag[i]);
+
+	frag_get_stats(&base_allocs, &base_reuses);
+
+	for (i = 0; i < NUM_FRAGS; i++) {
+		if (!frag_start(&frag[i], 0x0040, 4000))
+			return 1;
+	}
+
+	for (i = 0; i < NUM_FRAGS; i++)
+		frag_clear(&frag[i]);
+
+	frag_get_stats(&allocs, &reuses);
+
+	if (reuses - base_reuses != 16 || allocs - base_allocs != 4) {
+		printf("frag: %lu reused, %lu allocated\n",
+				reuses - base_reuses, allocs - base_allocs);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	srand(1);
+
+	err |= test_reassembly();
+	err |= test_classes();
+	err |= test_reuse();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
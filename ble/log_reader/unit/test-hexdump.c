@@ -0,0 +1,280 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "hex.h"
+
+/*
+ * Checks the table driven hexdump rows and address strings against the
+ * original per-byte formatters, and with -b times both over a range of
+ * payload sizes.
+ */
+
+#define MAX_DUMP	(4096 * 20)
+
+static char ref_buf[MAX_DUMP];
+static char new_buf[MAX_DUMP];
+
+/* Formatter used by packet_hexdump() before the lookup tables */
+static size_t ref_hexdump(const unsigned char *buf, uint16_t len, char *out)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+	char str[68];
+	size_t pos = 0;
+	uint16_t i;
+
+	if (!len)
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		str[((i % 16) * 3) + 0] = hexdigits[buf[i] >> 4];
+		str[((i % 16) * 3) + 1] = hexdigits[buf[i] & 0xf];
+		str[((i % 16) * 3) + 2] = ' ';
+		str[(i % 16) + 49] = isprint(buf[i]) ? buf[i] : '.';
+
+		if ((i + 1) % 16 == 0) {
+			str[47] = ' ';
+			str[48] = ' ';
+			str[65] = '\0';
+			pos += sprintf(out + pos, "%s\n", str);
+			str[0] = ' ';
+		}
+	}
+
+	if (i % 16 > 0) {
+		uint16_t j;
+		for (j = (i % 16); j < 16; j++) {
+			str[(j * 3) + 0] = ' ';
+			str[(j * 3) + 1] = ' ';
+			str[(j * 3) + 2] = ' ';
+			str[j + 49] = ' ';
+		}
+		str[47] = ' ';
+		str[48] = ' ';
+		str[65] = '\0';
+		pos += sprintf(out + pos, "%s\n", str);
+	}
+
+	return pos;
+}
+
+/* Same loop as packet_hexdump() */
+static size_t new_hexdump(const unsigned char *buf, uint16_t len, char *out)
+{
+	char str[HEX_ROW_SIZE];
+	size_t pos = 0;
+	unsigned int i;
+
+	for (i = 0; i < len; i += HEX_ROW_BYTES) {
+		hex_row(buf + i, len - i, str);
+		memcpy(out + pos, str, HEX_ROW_SIZE - 1);
+		pos += HEX_ROW_SIZE - 1;
+		out[pos++] = '\n';
+	}
+
+	out[pos] = '\0';
+
+	return pos;
+}
+
+static void ref_addr2str(const uint8_t *addr, char *str)
+{
+	sprintf(str, "%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
+			addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+}
+
+static void fill_random(uint8_t *buf, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = rand();
+}
+
+static int test_hexdump(void)
+{
+	uint8_t buf[4096];
+	unsigned int len, round;
+	size_t ref_len, new_len;
+
+	/* Every byte value in every column */
+	for (len = 0; len < sizeof(buf); len++)
+		buf[len] = len + len / 256;
+
+	for (len = 0; len <= sizeof(buf); len++) {
+		for (round = 0; round < 4; round++) {
+			ref_len = ref_hexdump(buf, len, ref_buf);
+			new_len = new_hexdump(buf, len, new_buf);
+
+			if (ref_len != new_len ||
+					memcmp(ref_buf, new_buf, ref_len)) {
+				printf("hexdump: mismatch at %u bytes\n", len);
+				return 1;
+			}
+
+			fill_random(buf, sizeof(buf));
+		}
+	}
+
+	return 0;
+}
+
+static int test_hexdump_max(void)
+{
+	uint8_t *buf;
+	char *ref, *new;
+	size_t size = (UINT16_MAX / 16 + 1) * 66 + 1;
+	int err = 0;
+
+	buf = malloc(UINT16_MAX);
+	ref = malloc(size);
+	new = malloc(size);
+	if (!buf || !ref || !new) {
+		err = 1;
+		goto done;
+	}
+
+	fill_random(buf, UINT16_MAX);
+
+	if (ref_hexdump(buf, UINT16_MAX, ref) !=
+				new_hexdump(buf, UINT16_MAX, new) ||
+				strcmp(ref, new)) {
+		printf("hexdump: mismatch at %u bytes\n", UINT16_MAX);
+		err = 1;
+	}
+
+done:
+	free(buf);
+	free(ref);
+	free(new);
+
+	return err;
+}
+
+static int test_addr2str(void)
+{
+	char ref[HEX_ADDR_SIZE], new[HEX_ADDR_SIZE];
+	uint8_t addr[6];
+	unsigned int i;
+
+	for (i = 0; i < 1000000; i++) {
+		if (i < 256)
+			memset(addr, i, sizeof(addr));
+		else
+			fill_random(addr, sizeof(addr));
+
+		ref_addr2str(addr, ref);
+
+		if (hex_addr2str(addr, new) != 17 || strcmp(ref, new)) {
+			printf("addr2str: %s != %s\n", new, ref);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static double elapsed_ns(const struct timespec *start,
+					const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+					(end->tv_nsec - start->tv_nsec);
+}
+
+static void bench_hexdump(void)
+{
+	static const uint16_t sizes[] = { 1, 7, 16, 31, 64, 255, 1021, 4096 };
+	uint8_t buf[4096];
+	struct timespec start, mid, end;
+	unsigned int i, round, rounds;
+
+	fill_random(buf, sizeof(buf));
+
+	printf("%-8s %12s %12s\n", "bytes", "ref ns/B", "table ns/B");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		rounds = 4000000 / sizes[i] + 1000;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (round = 0; round < rounds; round++)
+			ref_hexdump(buf, sizes[i], ref_buf);
+		clock_gettime(CLOCK_MONOTONIC, &mid);
+		for (round = 0; round < rounds; round++)
+			new_hexdump(buf, sizes[i], new_buf);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		printf("%-8u %12.2f %12.2f\n", sizes[i],
+			elapsed_ns(&start, &mid) / rounds / sizes[i],
+			elapsed_ns(&mid, &end) / rounds / sizes[i]);
+	}
+}
+
+static void bench_addr2str(void)
+{
+	char str[HEX_ADDR_SIZE];
+	uint8_t addr[256][6];
+	struct timespec start, mid, end;
+	unsigned int i, rounds = 4000000;
+
+	fill_random(&addr[0][0], sizeof(addr));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < rounds; i++)
+		ref_addr2str(addr[i & 0xff], str);
+	clock_gettime(CLOCK_MONOTONIC, &mid);
+	for (i = 0; i < rounds; i++)
+		hex_addr2str(addr[i & 0xff], str);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("addr2str %12.2f %12.2f ns/address\n",
+				elapsed_ns(&start, &mid) / rounds,
+				elapsed_ns(&mid, &end) / rounds);
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	srand(1);
+
+	if (argc > 1 && !strcmp(argv[1], "-b")) {
+		bench_hexdump();
+		bench_addr2str();
+		return 0;
+	}
+
+	err |= test_hexdump();
+	err |= test_hexdump_max();
+	err |= test_addr2str();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
@@ -0,0 +1,151 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "manufacturer.h"
+
+/*
+ * Checks the manufacturer data parsers against the test vectors in the
+ * Ruuvi data format specifications and the sample in the AltBeacon
+ * specification.
+ */
+
+static const struct {
+	const char *name;
+	uint8_t data[24];
+	uint8_t len;
+	struct ruuvi_data expect;
+} ruuvi_vectors[] = {
+	{ "RAWv1 valid",
+	  { 0x03, 0x29, 0x1a, 0x1e, 0xce, 0x1e, 0xfc, 0x18, 0xf9, 0x42,
+	    0x02, 0xca, 0x0b, 0x53 }, 14,
+	  { 0x03, 26300, 205000, 102766, { -1000, -1726, 714 }, 2899 } },
+	{ "RAWv1 maximum",
+	  { 0x03, 0xff, 0x7f, 0x63, 0xff, 0xff, 0x7f, 0xff, 0x7f, 0xff,
+	    0x7f, 0xff, 0xff, 0xff }, 14,
+	  { 0x03, 127990, 1275000, 115535, { 32767, 32767, 32767 },
+	    65535 } },
+	{ "RAWv1 minimum",
+	  { 0x03, 0x00, 0xff, 0x63, 0x00, 0x00, 0x80, 0x01, 0x80, 0x01,
+	    0x80, 0x01, 0x00, 0x00 }, 14,
+	  { 0x03, -127990, 0, 50000, { -32767, -32767, -32767 }, 0 } },
+	{ "RAWv2 valid",
+	  { 0x05, 0x12, 0xfc, 0x53, 0x94, 0xc3, 0x7c, 0x00, 0x04, 0xff,
+	    0xfc, 0x04, 0x0c, 0xac, 0x36, 0x42, 0x00, 0xcd, 0xcb, 0xb8,
+	    0x33, 0x4c, 0x88, 0x4f }, 24,
+	  { 0x05, 24300, 534900, 100044, { 4, -4, 1036 }, 2977, 4, 66,
+	    205, { 0xcb, 0xb8, 0x33, 0x4c, 0x88, 0x4f } } },
+	{ "RAWv2 maximum",
+	  { 0x05, 0x7f, 0xff, 0xff, 0xfe, 0xff, 0xfe, 0x7f, 0xff, 0x7f,
+	    0xff, 0x7f, 0xff, 0xff, 0xde, 0xfe, 0xff, 0xfe, 0xcb, 0xb8,
+	    0x33, 0x4c, 0x88, 0x4f }, 24,
+	  { 0x05, 163835, 1638350, 115534, { 32767, 32767, 32767 },
+	    3646, 20, 254, 65534,
+	    { 0xcb, 0xb8, 0x33, 0x4c, 0x88, 0x4f } } },
+	{ "RAWv2 minimum",
+	  { 0x05, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 0x80,
+	    0x01, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0xcb, 0xb8,
+	    0x33, 0x4c, 0x88, 0x4f }, 24,
+	  { 0x05, -163835, 0, 50000, { -32767, -32767, -32767 }, 1600,
+	    -40, 0, 0, { 0xcb, 0xb8, 0x33, 0x4c, 0x88, 0x4f } } },
+};
+
+static int test_ruuvi(void)
+{
+	static const uint8_t unknown[] = { 0x04, 0x00, 0x00 };
+	struct ruuvi_data ruuvi;
+	unsigned int i;
+	int err = 0;
+
+	for (i = 0; i < sizeof(ruuvi_vectors) / sizeof(ruuvi_vectors[0]);
+									i++) {
+		if (!ruuvi_parse(ruuvi_vectors[i].data, ruuvi_vectors[i].len,
+								&ruuvi) ||
+				memcmp(&ruuvi, &ruuvi_vectors[i].expect,
+							sizeof(ruuvi))) {
+			printf("ruuvi: %s vector differs\n",
+						ruuvi_vectors[i].name);
+			err = 1;
+		}
+
+		/* Truncated payloads fall back to the hex field */
+		if (ruuvi_parse(ruuvi_vectors[i].data,
+					ruuvi_vectors[i].len - 1, &ruuvi)) {
+			printf("ruuvi: truncated %s vector accepted\n",
+						ruuvi_vectors[i].name);
+			err = 1;
+		}
+	}
+
+	if (ruuvi_parse(unknown, sizeof(unknown), &ruuvi)) {
+		printf("ruuvi: unknown data format accepted\n");
+		err = 1;
+	}
+
+	return err;
+}
+
+static int test_altbeacon(void)
+{
+	static const uint8_t sample[] = {
+		0xbe, 0xac, 0x2f, 0x23, 0x44, 0x54, 0xcf, 0x6d, 0x4a, 0x0f,
+		0xad, 0xf2, 0xf4, 0x91, 0x1b, 0xa9, 0xff, 0xa6, 0x00, 0x01,
+		0x00, 0x02, 0xc5, 0x00,
+	};
+	struct altbeacon_data beacon;
+	uint8_t other[sizeof(sample)];
+
+	if (!altbeacon_parse(sample, sizeof(sample), &beacon) ||
+			memcmp(beacon.id, sample + 2, sizeof(beacon.id)) ||
+			beacon.ref_rssi != -59 || beacon.reserved != 0x00) {
+		printf("altbeacon: sample differs\n");
+		return 1;
+	}
+
+	if (altbeacon_parse(sample, sizeof(sample) - 1, &beacon)) {
+		printf("altbeacon: truncated sample accepted\n");
+		return 1;
+	}
+
+	/* Other data under the same company has a different beacon code */
+	memcpy(other, sample, sizeof(other));
+	other[1] = 0xad;
+
+	if (altbeacon_parse(other, sizeof(other), &beacon)) {
+		printf("altbeacon: wrong beacon code accepted\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	err |= test_ruuvi();
+	err |= test_altbeacon();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
@@ -0,0 +1,278 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+#include "ttyring.h"
+
+/*
+ * Writes frames into the master side of a pseudo terminal and drains
+ * the slave side through the TTY ring, the same way control_tty() does
+ * for a serial port. Garbage bytes are injected between some frames and
+ * every one of them has to be resynced without losing the frame that
+ * follows it.
+ */
+
+#define NUM_FRAMES	5000
+#define GARBAGE_EVERY	50
+#define HDR_LEN		5
+
+static const uint8_t garbage[] = { 0xff, 0xff, 0xff };
+
+struct writer {
+	int fd;
+	int err;
+};
+
+struct reader {
+	unsigned int received;
+	int err;
+};
+
+static uint16_t frame_size(unsigned int seq)
+{
+	return 1 + (seq * 7) % 240;
+}
+
+static uint16_t frame_opcode(unsigned int seq)
+{
+	return BTSNOOP_OPCODE_COMMAND_PKT + seq % 4;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len) {
+		ssize_t written = write(fd, buf, len);
+
+		if (written < 0)
+			return -1;
+
+		buf += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+static void *writer_func(void *user_data)
+{
+	struct writer *w = user_data;
+	uint8_t buf[6 + HDR_LEN + 240];
+	unsigned int seq, i;
+
+	for (seq = 0; seq < NUM_FRAMES; seq++) {
+		uint16_t size = frame_size(seq);
+		uint16_t data_len = 4 + HDR_LEN + size;
+
+		if (seq % GARBAGE_EVERY == GARBAGE_EVERY - 1 &&
+				write_all(w->fd, garbage, sizeof(garbage)) < 0)
+			goto fail;
+
+		buf[0] = data_len & 0xff;
+		buf[1] = data_len >> 8;
+		buf[2] = frame_opcode(seq) & 0xff;
+		buf[3] = frame_opcode(seq) >> 8;
+		buf[4] = 0;
+		buf[5] = HDR_LEN;
+		buf[6] = 8;
+		buf[7] = seq & 0xff;
+		buf[8] = (seq >> 8) & 0xff;
+		buf[9] = (seq >> 16) & 0xff;
+		buf[10] = seq >> 24;
+
+		for (i = 0; i < size; i++)
+			buf[11 + i] = seq + i;
+
+		if (write_all(w->fd, buf, 2 + data_len) < 0)
+			goto fail;
+	}
+
+	return NULL;
+
+fail:
+	perror("ttyring: write to pty failed");
+	w->err = 1;
+	return NULL;
+}
+
+static void frame_callback(struct timeval *tv, uint16_t opcode,
+				uint32_t drops, const void *data,
+				uint16_t size, void *user_data)
+{
+	struct reader *r = user_data;
+	unsigned int seq = r->received++;
+	const uint8_t *buf = data;
+	unsigned int i;
+
+	if (r->err)
+		return;
+
+	if (!tv || tv->tv_sec != seq / 10000 ||
+				tv->tv_usec != (seq % 10000) * 100) {
+		printf("ttyring: frame %u has the wrong timestamp\n", seq);
+		r->err = 1;
+		return;
+	}
+
+	if (opcode != frame_opcode(seq) || drops ||
+					size != frame_size(seq)) {
+		printf("ttyring: frame %u has opcode %u size %u\n", seq,
+								opcode, size);
+		r->err = 1;
+		return;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (buf[i] != (uint8_t) (seq + i)) {
+			printf("ttyring: frame %u payload differs at %u\n",
+								seq, i);
+			r->err = 1;
+			return;
+		}
+	}
+}
+
+static int open_pty(int *slave)
+{
+	struct termios ti;
+	int master;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0)
+		return -1;
+
+	if (grantpt(master) < 0 || unlockpt(master) < 0)
+		goto fail;
+
+	*slave = open(ptsname(master), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if (*slave < 0)
+		goto fail;
+
+	if (tcgetattr(*slave, &ti) < 0) {
+		close(*slave);
+		goto fail;
+	}
+
+	cfmakeraw(&ti);
+
+	if (tcsetattr(*slave, TCSANOW, &ti) < 0) {
+		close(*slave);
+		goto fail;
+	}
+
+	return master;
+
+fail:
+	close(master);
+	return -1;
+}
+
+static int test_resync(void)
+{
+	struct tty_ring_stats stats;
+	struct tty_ring *ring;
+	struct writer w;
+	struct reader r;
+	pthread_t thread;
+	int master, slave;
+	int err = 0;
+
+	memset(&stats, 0, sizeof(stats));
+	memset(&w, 0, sizeof(w));
+	memset(&r, 0, sizeof(r));
+
+	master = open_pty(&slave);
+	if (master < 0) {
+		perror("ttyring: failed to open pty");
+		return 1;
+	}
+
+	ring = tty_ring_new(&stats, frame_callback, &r);
+	if (!ring) {
+		err = 1;
+		goto done;
+	}
+
+	w.fd = master;
+
+	if (pthread_create(&thread, NULL, writer_func, &w)) {
+		err = 1;
+		goto done;
+	}
+
+	while (r.received < NUM_FRAMES && !r.err) {
+		struct pollfd pfd = { .fd = slave, .events = POLLIN };
+
+		if (poll(&pfd, 1, 2000) <= 0) {
+			printf("ttyring: timed out after %u frames\n",
+								r.received);
+			err = 1;
+			break;
+		}
+
+		tty_ring_drain(ring, slave);
+	}
+
+	/* The writer blocks on a full pty once nothing drains it */
+	if (err || r.err)
+		pthread_cancel(thread);
+
+	pthread_join(thread, NULL);
+
+	if (w.err || r.err)
+		err = 1;
+
+	if (!err && (stats.frames != NUM_FRAMES ||
+			stats.resyncs != NUM_FRAMES / GARBAGE_EVERY ||
+			stats.skipped != stats.resyncs * sizeof(garbage))) {
+		printf("ttyring: %lu frames, %lu resyncs, %lu bytes "
+				"skipped\n", stats.frames, stats.resyncs,
+				stats.skipped);
+		err = 1;
+	}
+
+done:
+	tty_ring_free(ring);
+	close(slave);
+	close(master);
+
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	int err = 0;
+
+	err |= test_resync();
+
+	printf("%s: %s\n", argv[0], err ? "FAIL" : "PASS");
+
+	return err;
+}
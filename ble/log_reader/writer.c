@@ -0,0 +1,593 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+
+#include "writer.h"
+
+/*
+ * Packets are serialized into large blocks on the caller's thread and a
+ * background thread writes full blocks to disk, so disk latency never
+ * stalls decoding or socket draining. Only when WRITER_MAX_QUEUE blocks
+ * are pending does the producer wait for the disk to catch up.
+ *
+ * With rotation enabled the output is split into numbered segments, each
+ * a standalone btsnoop file. Every block belongs to exactly one segment
+ * and the background thread switches files when the segment changes,
+ * appending the finished segment to the manifest.
+ */
+#define WRITER_BLOCK_SIZE	(1024 * 1024)
+#define WRITER_MAX_QUEUE	256
+#define WRITER_MAX_FREE		4
+
+struct btsnoop_hdr {
+	uint8_t id[8];
+	uint32_t version;
+	uint32_t type;
+} __attribute__ ((packed));
+
+struct btsnoop_pkt {
+	uint32_t size;
+	uint32_t len;
+	uint32_t flags;
+	uint32_t drops;
+	uint64_t ts;
+} __attribute__ ((packed));
+
+static const uint8_t btsnoop_id[] = { 0x62, 0x74, 0x73, 0x6e,
+				      0x6f, 0x6f, 0x70, 0x00 };
+
+struct writer_segment {
+	unsigned int num;
+	struct timeval first;
+	struct timeval last;
+	unsigned long packets;
+	uint64_t bytes;
+};
+
+struct writer_block {
+	struct writer_block *next;
+	struct writer_segment *segment;
+	size_t len;
+	uint8_t data[WRITER_BLOCK_SIZE];
+};
+
+struct writer {
+	int fd;
+	char *path;
+	uint32_t format;
+	unsigned int sync_interval;
+	struct timeval last_sync;
+	uint64_t rotate_size;
+	uint64_t rotate_time;
+	int manifest_fd;
+	struct writer_segment *segment;
+	struct writer_segment *open_segment;
+	struct writer_block *current;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct writer_block *queue_head;
+	struct writer_block *queue_tail;
+	struct writer_block *free_list;
+	unsigned int queue_depth;
+	unsigned int free_count;
+	bool busy;
+	bool quit;
+	uint64_t bytes_written;
+	unsigned long blocks_written;
+	unsigned long write_errors;
+	unsigned long syncs;
+	unsigned int max_queue_depth;
+	uint64_t flush_total;
+	uint64_t flush_max;
+};
+
+static uint64_t elapsed_usec(const struct timeval *start,
+						const struct timeval *end)
+{
+	struct timeval res;
+
+	timersub(end, start, &res);
+
+	return res.tv_sec * 1000000ULL + res.tv_usec;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t written;
+
+		written = write(fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return true;
+}
+
+static bool rotating(struct writer *writer)
+{
+	return writer->rotate_size || writer->rotate_time;
+}
+
+static int open_file(struct writer *writer, unsigned int num)
+{
+	struct btsnoop_hdr hdr;
+	char *path = writer->path;
+	int fd;
+
+	if (rotating(writer) && asprintf(&path, "%s.%04u",
+						writer->path, num) < 0)
+		return -1;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+	if (path != writer->path)
+		free(path);
+
+	if (fd < 0)
+		return -1;
+
+	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+	hdr.version = htobe32(1);
+	hdr.type = htobe32(writer->format);
+
+	if (!write_all(fd, (const uint8_t *) &hdr, sizeof(hdr))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void close_segment(struct writer *writer)
+{
+	struct writer_segment *segment = writer->open_segment;
+	char line[128];
+	int len;
+
+	if (writer->sync_interval)
+		fdatasync(writer->fd);
+
+	if (writer->manifest_fd >= 0 && segment) {
+		len = snprintf(line, sizeof(line), "%u %lu.%06lu %lu.%06lu "
+				"%lu %" PRIu64 "\n", segment->num,
+				(unsigned long) segment->first.tv_sec,
+				(unsigned long) segment->first.tv_usec,
+				(unsigned long) segment->last.tv_sec,
+				(unsigned long) segment->last.tv_usec,
+				segment->packets, segment->bytes);
+		if (!write_all(writer->manifest_fd, (const uint8_t *) line,
+									len))
+			writer->write_errors++;
+	}
+
+	free(segment);
+	writer->open_segment = NULL;
+}
+
+static void switch_segment(struct writer *writer,
+					struct writer_segment *segment)
+{
+	close_segment(writer);
+	close(writer->fd);
+
+	writer->fd = open_file(writer, segment->num);
+	if (writer->fd < 0)
+		writer->write_errors++;
+
+	writer->open_segment = segment;
+}
+
+static void write_block(struct writer *writer, struct writer_block *block)
+{
+	struct timeval start, end;
+	uint64_t usec;
+
+	gettimeofday(&start, NULL);
+
+	if (block->segment != writer->open_segment)
+		switch_segment(writer, block->segment);
+
+	if (!write_all(writer->fd, block->data, block->len))
+		writer->write_errors++;
+
+	if (writer->sync_interval && elapsed_usec(&writer->last_sync, &start) >=
+				writer->sync_interval * 1000000ULL) {
+		fdatasync(writer->fd);
+		writer->last_sync = start;
+		writer->syncs++;
+	}
+
+	gettimeofday(&end, NULL);
+
+	usec = elapsed_usec(&start, &end);
+
+	writer->bytes_written += block->len;
+	writer->blocks_written++;
+	writer->flush_total += usec;
+	if (usec > writer->flush_max)
+		writer->flush_max = usec;
+}
+
+static void *writer_thread(void *user_data)
+{
+	struct writer *writer = user_data;
+	struct writer_block *block;
+
+	pthread_mutex_lock(&writer->lock);
+
+	while (1) {
+		while (!writer->queue_head && !writer->quit)
+			pthread_cond_wait(&writer->cond, &writer->lock);
+
+		block = writer->queue_head;
+		if (!block)
+			break;
+
+		writer->queue_head = block->next;
+		if (!writer->queue_head)
+			writer->queue_tail = NULL;
+		writer->queue_depth--;
+		writer->busy = true;
+
+		pthread_mutex_unlock(&writer->lock);
+
+		write_block(writer, block);
+
+		pthread_mutex_lock(&writer->lock);
+
+		writer->busy = false;
+
+		if (writer->free_count < WRITER_MAX_FREE) {
+			block->next = writer->free_list;
+			writer->free_list = block;
+			writer->free_count++;
+		} else
+			free(block);
+
+		pthread_cond_broadcast(&writer->cond);
+	}
+
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+static struct writer_block *get_block(struct writer *writer)
+{
+	struct writer_block *block;
+
+	pthread_mutex_lock(&writer->lock);
+
+	block = writer->free_list;
+	if (block) {
+		writer->free_list = block->next;
+		writer->free_count--;
+	}
+
+	pthread_mutex_unlock(&writer->lock);
+
+	if (!block) {
+		block = malloc(sizeof(*block));
+		if (!block)
+			return NULL;
+	}
+
+	block->next = NULL;
+	block->segment = writer->segment;
+	block->len = 0;
+
+	return block;
+}
+
+void writer_submit(struct writer *writer)
+{
+	struct writer_block *block;
+
+	if (!writer || !writer->current || !writer->current->len)
+		return;
+
+	block = writer->current;
+	writer->current = NULL;
+
+	pthread_mutex_lock(&writer->lock);
+
+	while (writer->queue_depth >= WRITER_MAX_QUEUE)
+		pthread_cond_wait(&writer->cond, &writer->lock);
+
+	if (writer->queue_tail)
+		writer->queue_tail->next = block;
+	else
+		writer->queue_head = block;
+	writer->queue_tail = block;
+
+	writer->queue_depth++;
+	if (writer->queue_depth > writer->max_queue_depth)
+		writer->max_queue_depth = writer->queue_depth;
+
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+}
+
+void writer_flush(struct writer *writer)
+{
+	if (!writer)
+		return;
+
+	writer_submit(writer);
+
+	pthread_mutex_lock(&writer->lock);
+
+	while (writer->queue_head || writer->busy)
+		pthread_cond_wait(&writer->cond, &writer->lock);
+
+	pthread_mutex_unlock(&writer->lock);
+
+	if (writer->sync_interval)
+		fdatasync(writer->fd);
+}
+
+static struct writer_segment *segment_new(unsigned int num)
+{
+	struct writer_segment *segment;
+
+	segment = new0(struct writer_segment, 1);
+	if (!segment)
+		return NULL;
+
+	segment->num = num;
+	segment->bytes = sizeof(struct btsnoop_hdr);
+
+	return segment;
+}
+
+struct writer *writer_open(const char *path, uint32_t format,
+				unsigned int sync_interval,
+				unsigned int rotate_size, unsigned int rotate_time)
+{
+	struct writer *writer;
+	char *manifest;
+
+	writer = new0(struct writer, 1);
+	if (!writer)
+		return NULL;
+
+	writer->path = strdup(path);
+	writer->format = format;
+	writer->sync_interval = sync_interval;
+	writer->rotate_size = rotate_size * 1024ULL * 1024ULL;
+	writer->rotate_time = rotate_time * 60000000ULL;
+	writer->manifest_fd = -1;
+	gettimeofday(&writer->last_sync, NULL);
+
+	writer->segment = segment_new(0);
+	if (!writer->path || !writer->segment)
+		goto failed;
+
+	writer->open_segment = writer->segment;
+
+	writer->fd = open_file(writer, 0);
+	if (writer->fd < 0)
+		goto failed;
+
+	if (rotating(writer)) {
+		if (asprintf(&manifest, "%s.manifest", path) < 0)
+			goto failed_close;
+
+		writer->manifest_fd = open(manifest, O_WRONLY | O_CREAT |
+						O_TRUNC | O_APPEND | O_CLOEXEC,
+					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		free(manifest);
+
+		if (writer->manifest_fd < 0)
+			goto failed_close;
+	}
+
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer)) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->lock);
+		goto failed_close;
+	}
+
+	return writer;
+
+failed_close:
+	if (writer->manifest_fd >= 0)
+		close(writer->manifest_fd);
+	close(writer->fd);
+failed:
+	free(writer->segment);
+	free(writer->path);
+	free(writer);
+	return NULL;
+}
+
+void writer_close(struct writer *writer)
+{
+	struct writer_block *block;
+
+	if (!writer)
+		return;
+
+	writer_flush(writer);
+
+	pthread_mutex_lock(&writer->lock);
+	writer->quit = true;
+	pthread_cond_broadcast(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+
+	while (writer->free_list) {
+		block = writer->free_list;
+		writer->free_list = block->next;
+		free(block);
+	}
+
+	free(writer->current);
+
+	/* A segment that never reached the disk is not in the manifest */
+	if (writer->segment != writer->open_segment)
+		free(writer->segment);
+
+	close_segment(writer);
+
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->lock);
+
+	if (writer->manifest_fd >= 0)
+		close(writer->manifest_fd);
+
+	close(writer->fd);
+	free(writer->path);
+	free(writer);
+}
+
+static bool need_rotate(struct writer *writer, const struct timeval *tv,
+								uint16_t size)
+{
+	struct writer_segment *segment = writer->segment;
+
+	if (!segment->packets)
+		return false;
+
+	if (writer->rotate_size && segment->bytes +
+			sizeof(struct btsnoop_pkt) + size > writer->rotate_size)
+		return true;
+
+	if (writer->rotate_time && timercmp(tv, &segment->first, >) &&
+			elapsed_usec(&segment->first, tv) >= writer->rotate_time)
+		return true;
+
+	return false;
+}
+
+bool writer_write_hci(struct writer *writer, const struct timeval *tv,
+			uint16_t index, uint16_t opcode, uint32_t drops,
+			const void *data, uint16_t size)
+{
+	struct btsnoop_pkt pkt;
+	struct timeval now;
+	uint64_t ts;
+
+	if (!writer)
+		return false;
+
+	if (!tv) {
+		gettimeofday(&now, NULL);
+		tv = &now;
+	}
+
+	if (rotating(writer) && need_rotate(writer, tv, size)) {
+		struct writer_segment *segment;
+
+		segment = segment_new(writer->segment->num + 1);
+		if (segment) {
+			writer_submit(writer);
+			writer->segment = segment;
+		}
+	}
+
+	if (writer->current &&
+		writer->current->len + sizeof(pkt) + size > WRITER_BLOCK_SIZE)
+		writer_submit(writer);
+
+	if (!writer->current) {
+		writer->current = get_block(writer);
+		if (!writer->current)
+			return false;
+	}
+
+	if (!writer->segment->packets)
+		writer->segment->first = *tv;
+
+	writer->segment->last = *tv;
+	writer->segment->packets++;
+	writer->segment->bytes += sizeof(pkt) + size;
+
+	/* Timestamps count microseconds since midnight, January 1st, 0 AD */
+	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
+
+	pkt.size  = htobe32(size);
+	pkt.len   = htobe32(size);
+	pkt.flags = htobe32(((uint32_t) index << 16) | opcode);
+	pkt.drops = htobe32(drops);
+	pkt.ts    = htobe64(ts + 0x00E03AB44A676000ll);
+
+	memcpy(writer->current->data + writer->current->len, &pkt, sizeof(pkt));
+	writer->current->len += sizeof(pkt);
+
+	memcpy(writer->current->data + writer->current->len, data, size);
+	writer->current->len += size;
+
+	return true;
+}
+
+void writer_print_stats(struct writer *writer)
+{
+	if (!writer || !writer->blocks_written)
+		return;
+
+	pthread_mutex_lock(&writer->lock);
+
+	printf("Trace writer: %" PRIu64 " bytes in %lu blocks\n",
+				writer->bytes_written, writer->blocks_written);
+	printf("  Flush latency: avg %" PRIu64 " us max %" PRIu64 " us\n",
+				writer->flush_total / writer->blocks_written,
+				writer->flush_max);
+	printf("  Queue depth: %u (max %u)\n", writer->queue_depth,
+						writer->max_queue_depth);
+
+	if (writer->syncs)
+		printf("  Syncs: %lu\n", writer->syncs);
+
+	if (writer->write_errors)
+		printf("  Write errors: %lu\n", writer->write_errors);
+
+	pthread_mutex_unlock(&writer->lock);
+}
@@ -0,0 +1,39 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+struct writer;
+
+struct writer *writer_open(const char *path, uint32_t format,
+				unsigned int sync_interval,
+				unsigned int rotate_size, unsigned int rotate_time);
+void writer_close(struct writer *writer);
+
+bool writer_write_hci(struct writer *writer, const struct timeval *tv,
+			uint16_t index, uint16_t opcode, uint32_t drops,
+			const void *data, uint16_t size);
+
+void writer_submit(struct writer *writer);
+void writer_flush(struct writer *writer);
+
+void writer_print_stats(struct writer *writer);
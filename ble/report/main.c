@@ -1,5 +1,6 @@
 #include "report.h"
 #include "report_reader.h"
+#include "report_record.h"
 
 #include <stdio.h>
 #include <glib.h>
@@ -19,7 +20,13 @@ int main( int argc, char **argv ) {
 	ignore_list = g_slist_prepend( ignore_list, "Data length" );
 	ignore_list = g_slist_prepend( ignore_list, "TX power" );
 
-	GSList *reports = read_reports(argv[1], ignore_list);
+	GSList *reports;
+
+	/* Record streams from the decoder need no text parsing */
+	if (is_record_file(argv[1]))
+		reports = read_record_reports(argv[1], ignore_list);
+	else
+		reports = read_reports(argv[1], ignore_list);
 /*	
 	elem = reports;
 	while (elem) {
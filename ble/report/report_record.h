@@ -0,0 +1,10 @@
+#ifndef __REPORT_RECORD_H__
+#define __REPORT_RECORD_H__
+
+#include "report.h"
+
+bool is_record_file(const char *file);
+
+GSList *read_record_reports(const char *file, GSList *ignore_list);
+
+#endif